@@ -0,0 +1,385 @@
+// scan throughput benchmark, compares each scanning backend against POSIX regexec
+// build: cc -O2 -pthread -o bench bench.c
+// usage: bench [size in MB]...    (defaults to 1 and 16, up to 1024)
+// output is one JSON object per line, one line per pattern, input and backend
+#define _GNU_SOURCE
+#define REGDX_NO_MAIN
+#include "regdx6.c"
+#include <stdint.h>
+#include <regex.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if 1 // corpus
+// every pattern is wrapped in .*( ).* for the anchored backends, the search and glushkov
+// backends take it as is and search for it themselves
+// posix is NULL for patterns which regcomp can't express
+struct pattern {
+	char *name;
+	char *regdx;
+	char *posix;
+} corpus[] = {
+	{ "string", "\"([^\"\\\\]|\\\\.)*\"", "\"([^\"\\\\]|\\\\.)*\"" },
+	{ "block_comment", "/\\*(.*\\*/.*)!\\*/", "/\\*([^*]|\\*+[^*/])*\\*+/" },
+	{ "line_comment", "//[^\\n]*", "//.*" },
+	{ "timestamp", "[0-9][0-9][0-9][0-9]-[0-9][0-9]-[0-9][0-9]T[0-9][0-9]:[0-9][0-9]:[0-9][0-9]", "[0-9]{4}-[0-9]{2}-[0-9]{2}T[0-9]{2}:[0-9]{2}:[0-9]{2}" },
+	{ "ipv4", "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+", "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+" },
+	{ "status_5xx", "status=5[0-9][0-9]", "status=5[0-9][0-9]" },
+	{ "level", "level=(ERROR|WARN|FATAL)", "level=(ERROR|WARN|FATAL)" },
+	{ "keywords", "error|warning|fatal|timeout|refused|denied|panic|abort", "error|warning|fatal|timeout|refused|denied|panic|abort" },
+	{ "c_keywords", "while|for|if|else|return|switch|case|break|struct|static", "while|for|if|else|return|switch|case|break|struct|static" },
+	{ "error_not_debug", "(.*error.*)&(.*debug.*)!", NULL },
+	{ "quoted_no_space", "\"[^\"]*\"&(.* .*)!", NULL },
+	{ "multi", "status=5[0-9][0-9]|level=(ERROR|WARN|FATAL)|error|warning|fatal|timeout|refused|denied|panic|abort|while|for|if|else|return|switch|case|break|struct|static|[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+",
+		"status=5[0-9][0-9]|level=(ERROR|WARN|FATAL)|error|warning|fatal|timeout|refused|denied|panic|abort|while|for|if|else|return|switch|case|break|struct|static|[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+" },
+};
+#define PATTERNS (sizeof(corpus) / sizeof(corpus[0]))
+#endif
+#if 1 // inputs
+uint64_t seed = 88172645463325252ULL;
+uint64_t rng() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+char *pick(char **words, int n) {
+	return words[rng() % n];
+}
+// uniformly random printable text with lines of 0 to 160 bytes
+void gen_random(char *buf, size_t size) {
+	size_t i = 0;
+	while(i < size) {
+		size_t len = rng() % 160;
+		for(size_t j = 0; j < len && i < size; j++)
+			buf[i++] = ' ' + rng() % 95;
+		if(i < size)
+			buf[i++] = '\n';
+	}
+}
+// log and source shaped lines that the corpus actually hits
+void gen_log(char *buf, size_t size) {
+	static char *levels[] = { "DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR", "FATAL" };
+	static char *words[] = { "request", "served", "error", "timeout", "user", "debug", "connection", "refused", "cache", "miss", "while", "return", "denied", "ok" };
+	size_t i = 0;
+	char line[512];
+	while(i < size) {
+		int n = 0;
+		switch(rng() % 4) {
+			case 0:
+			case 1:
+				n = snprintf(line, sizeof(line), "2024-%02i-%02iT%02i:%02i:%02i level=%s ip=%i.%i.%i.%i status=%i msg=\"%s %s\" %s %s\n",
+					(int)(rng() % 12 + 1), (int)(rng() % 28 + 1), (int)(rng() % 24), (int)(rng() % 60), (int)(rng() % 60),
+					pick(levels, 7), (int)(rng() % 256), (int)(rng() % 256), (int)(rng() % 256), (int)(rng() % 256),
+					(int)(rng() % 5 + 1) * 100 + (int)(rng() % 4), pick(words, 14), pick(words, 14), pick(words, 14), pick(words, 14));
+			break;
+			case 2:
+				n = snprintf(line, sizeof(line), "\tif(%s) return %s; // %s %s\n", pick(words, 14), pick(words, 14), pick(words, 14), pick(words, 14));
+			break;
+			case 3:
+				n = snprintf(line, sizeof(line), "/* %s %s */ %s(\"%s\\\"%s\");\n", pick(words, 14), pick(words, 14), pick(words, 14), pick(words, 14), pick(words, 14));
+			break;
+		}
+		for(int j = 0; j < n && i < size; j++)
+			buf[i++] = line[j];
+	}
+}
+#endif
+#if 1 // counters
+// cache and TLB misses over each throughput pass, the same ones as perf stat -e
+// L1-dcache-load-misses,LLC-load-misses,dTLB-load-misses. they come out null where
+// the kernel or the machine doesn't count them
+struct counter {
+	char *name;
+	uint64_t cache;
+	int fd;
+	long count;
+} counters[] = {
+	{ "l1d_misses", PERF_COUNT_HW_CACHE_L1D },
+	{ "llc_misses", PERF_COUNT_HW_CACHE_LL },
+	{ "dtlb_misses", PERF_COUNT_HW_CACHE_DTLB },
+};
+#define COUNTERS (sizeof(counters) / sizeof(counters[0]))
+void counters_open() {
+	for(int i = 0; i < COUNTERS; i++) {
+		struct perf_event_attr a = { 0 };
+		a.size = sizeof(a);
+		a.type = PERF_TYPE_HW_CACHE;
+		a.config = counters[i].cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+		a.disabled = 1;
+		a.exclude_kernel = 1;
+		a.exclude_hv = 1;
+		counters[i].fd = syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+	}
+}
+void counters_start() {
+	for(int i = 0; i < COUNTERS; i++)
+		if(counters[i].fd >= 0) {
+			ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+}
+void counters_stop() {
+	for(int i = 0; i < COUNTERS; i++) {
+		counters[i].count = -1;
+		if(counters[i].fd >= 0) {
+			ioctl(counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+			if(read(counters[i].fd, &counters[i].count, sizeof(long)) != sizeof(long))
+				counters[i].count = -1;
+		}
+	}
+}
+void counters_print() {
+	for(int i = 0; i < COUNTERS; i++)
+		if(counters[i].count >= 0)
+			printf(",\"%s\":%li", counters[i].name, counters[i].count);
+		else
+			printf(",\"%s\":null", counters[i].name);
+}
+#endif
+#if 1 // timing
+double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+int cmp_double(const void *a, const void *b) {
+	double x = *(double *)a, y = *(double *)b;
+	return (x > y) - (x < y);
+}
+// every backend is driven through one of these, one call per line, or BATCH lines per
+// call for the throughput pass if it has a batch()
+struct backend {
+	char *name;
+	bool (*match)(void *ctx, char *s, size_t len);
+	void *ctx;
+	void (*batch)(void *ctx, char **s, size_t *len, size_t n, bool *out);
+};
+typedef struct backend Backend;
+bool run_table(void *ctx, char *s, size_t len) {
+	Table *t = ctx;
+	return table_match(t, t->start, s, len);
+}
+bool run_derive(void *ctx, char *s, size_t len) {
+	return derive_match(*(Reg *)ctx, s, len);
+}
+bool run_search(void *ctx, char *s, size_t len) {
+	return search(ctx, s, len);
+}
+void run_table_batch(void *ctx, char **s, size_t *len, size_t n, bool *out) {
+	Table *t = ctx;
+	table_match_batch(t, t->start, s, len, n, out);
+}
+void run_search_batch(void *ctx, char **s, size_t *len, size_t n, bool *out) {
+	search_batch(ctx, s, len, n, out);
+}
+bool run_glushkov(void *ctx, char *s, size_t len) {
+	return glushkov_search(ctx, s, len);
+}
+bool run_posix(void *ctx, char *s, size_t len) {
+	regmatch_t m = { .rm_so = 0, .rm_eo = len };
+	return regexec(ctx, s, 1, &m, REG_STARTEND) == 0;
+}
+#define SAMPLES (1 << 16)
+#define BATCH 1024
+void measure(Backend *b, struct pattern *p, char *input, char *buf, size_t size, double compile, int nstates) {
+	// throughput pass over every line
+	size_t lines = 0, matches = 0, queued = 0;
+	static char *batch[BATCH];
+	static size_t lens[BATCH];
+	static bool out[BATCH];
+	counters_start();
+	double start = now();
+	for(char *s = buf, *end = buf + size; s < end;) {
+		char *nl = memchr(s, '\n', end - s);
+		if(nl == NULL)
+			nl = end;
+		if(b->batch != NULL) {
+			batch[queued] = s;
+			lens[queued++] = nl - s;
+		} else {
+			matches += b->match(b->ctx, s, nl - s);
+		}
+		lines++;
+		s = nl + 1;
+		if(queued == BATCH || (queued > 0 && s >= end)) {
+			b->batch(b->ctx, batch, lens, queued, out);
+			for(size_t i = 0; i < queued; i++)
+				matches += out[i];
+			queued = 0;
+		}
+	}
+	double secs = now() - start;
+	counters_stop();
+	// latency pass over an evenly strided sample of the lines
+	static double lat[SAMPLES];
+	size_t stride = lines / SAMPLES + 1, n = 0, line = 0;
+	for(char *s = buf, *end = buf + size; s < end && n < SAMPLES; line++) {
+		char *nl = memchr(s, '\n', end - s);
+		if(nl == NULL)
+			nl = end;
+		if(line % stride == 0) {
+			double t0 = now();
+			b->match(b->ctx, s, nl - s);
+			lat[n++] = now() - t0;
+		}
+		s = nl + 1;
+	}
+	qsort(lat, n, sizeof(double), cmp_double);
+	printf("{\"pattern\":\"%s\",\"input\":\"%s\",\"bytes\":%zu,\"backend\":\"%s\",\"states\":%i,\"compile_s\":%.6f,"
+		"\"seconds\":%.6f,\"gbps\":%.4f,\"lines\":%zu,\"matches\":%zu,\"matches_per_s\":%.1f,\"p50_ns\":%.0f,\"p99_ns\":%.0f",
+		p->name, input, size, b->name, nstates, compile, secs, size / secs / 1e9, lines, matches, matches / secs,
+		lat[n / 2] * 1e9, lat[n * 99 / 100] * 1e9);
+	counters_print();
+	printf("}\n");
+	fflush(stdout);
+}
+// the lines as a column, rows back to back with no newlines, built once and not timed
+// the select backends run table_select() over all of it in one call, with the rows
+// sorted for select_sorted, and have no per line latency
+char *column, *input_end;
+size_t *offsets, rows;
+size_t line_len(char *s) {
+	char *nl = memchr(s, '\n', input_end - s);
+	return (nl == NULL ? input_end : nl) - s;
+}
+int cmp_line(const void *a, const void *b) {
+	char *x = *(char **)a, *y = *(char **)b;
+	size_t n = line_len(x), m = line_len(y);
+	int c = memcmp(x, y, n < m ? n : m);
+	return c ? c : (n > m) - (n < m);
+}
+void make_column(char *buf, size_t size, bool sorted) {
+	char **lines = NULL;
+	size_t cap = 0;
+	rows = 0;
+	input_end = buf + size;
+	for(char *s = buf, *end = buf + size; s < end;) {
+		char *nl = memchr(s, '\n', end - s);
+		if(rows == cap && (lines = realloc(lines, sizeof(char *) * (cap = cap ? cap * 2 : 1024))) == NULL)
+			die("out of memory for column");
+		lines[rows++] = s;
+		s = nl == NULL ? end : nl + 1;
+	}
+	if(sorted)
+		qsort(lines, rows, sizeof(char *), cmp_line);
+	column = realloc(column, size);
+	offsets = realloc(offsets, sizeof(size_t) * (rows + 1));
+	if(column == NULL || offsets == NULL)
+		die("out of memory for column");
+	offsets[0] = 0;
+	for(size_t i = 0; i < rows; i++) {
+		size_t len = line_len(lines[i]);
+		memcpy(&column[offsets[i]], lines[i], len);
+		offsets[i + 1] = offsets[i] + len;
+	}
+	free(lines);
+}
+void measure_column(char *name, Table *t, struct pattern *p, char *input, char *buf, size_t size, double compile, bool sorted) {
+	make_column(buf, size, sorted);
+	uint64_t *selected = malloc(sizeof(uint64_t) * ((rows + 63) / 64));
+	if(selected == NULL)
+		die("out of memory for selection");
+	counters_start();
+	double start = now();
+	table_select(t, t->start, column, offsets, rows, sorted, selected, NULL);
+	double secs = now() - start;
+	counters_stop();
+	size_t matches = 0;
+	for(size_t i = 0; i < (rows + 63) / 64; i++)
+		matches += __builtin_popcountll(selected[i]);
+	printf("{\"pattern\":\"%s\",\"input\":\"%s\",\"bytes\":%zu,\"backend\":\"%s\",\"states\":%i,\"compile_s\":%.6f,"
+		"\"seconds\":%.6f,\"gbps\":%.4f,\"lines\":%zu,\"matches\":%zu,\"matches_per_s\":%.1f",
+		p->name, input, size, name, t->states, compile, secs, size / secs / 1e9, rows, matches, matches / secs);
+	counters_print();
+	printf("}\n");
+	fflush(stdout);
+	free(selected);
+}
+#endif
+// each pattern gets its own child, so one that crashes or runs out of nodes doesn't take the
+// rest with it, and each starts from an empty node store with its own rss
+void bench(struct pattern *p, char *input, char *buf, size_t size) {
+	pid_t pid = fork();
+	if(pid < 0)
+		die("fork failed");
+	if(pid > 0) {
+		waitpid(pid, NULL, 0);
+		return;
+	}
+	counters_open();
+	Context *c = context_new(&names);
+	char *src = malloc(strlen(p->regdx) + 8);
+	sprintf(src, ".*(%s).*", p->regdx);
+	double start = now();
+	Reg r = parse(&names, src);
+	double parsed = now();
+	Table *t = export(c, r);
+	double exported = now();
+	Backend derive_backend = { "derive", run_derive, &r };
+	measure(&derive_backend, p, input, buf, size, parsed - start, 0);
+	Backend table_backend = { "table", run_table, t };
+	measure(&table_backend, p, input, buf, size, exported - start, t->states);
+	// the same states before table_pack(), byte wide rows in labelling order. a pattern
+	// that fell back to a lazy table left c with no states to lay out
+	if(!t->lazy) {
+		Table *raw = table_extend(c, NULL);
+		raw->start = row(c, r);
+		Backend raw_backend = { "table_unpacked", run_table, raw };
+		measure(&raw_backend, p, input, buf, size, exported - start, raw->states);
+	}
+	measure_column("select", t, p, input, buf, size, exported - start, false);
+	measure_column("select_sorted", t, p, input, buf, size, exported - start, true);
+	Backend table_batch_backend = { "table_batch", run_table, t, run_table_batch };
+	measure(&table_batch_backend, p, input, buf, size, exported - start, t->states);
+	if(p->posix != NULL) {
+		regex_t re;
+		start = now();
+		if(regcomp(&re, p->posix, REG_EXTENDED | REG_NOSUB) != 0)
+			die("regcomp failed on %s", p->posix);
+		Backend posix_backend = { "posix", run_posix, &re };
+		measure(&posix_backend, p, input, buf, size, now() - start, 0);
+	}
+	start = now();
+	Finder *f = finder(c, parse(&names, p->regdx));
+	double found = now() - start;
+	Backend search_backend = { "search", run_search, f };
+	measure(&search_backend, p, input, buf, size, found, f->t->states); // states of all three roots
+	Backend search_batch_backend = { "search_batch", run_search, f, run_search_batch };
+	measure(&search_batch_backend, p, input, buf, size, found, f->t->states);
+	start = now();
+	Glushkov *g = glushkov(parse(&names, p->regdx));
+	if(g != NULL) {
+		Backend glushkov_backend = { "glushkov", run_glushkov, g };
+		measure(&glushkov_backend, p, input, buf, size, now() - start, g->n); // positions stand in for states
+	}
+	exit(0);
+}
+int main(int argc, char *argv[]) {
+	size_t sizes[16] = { 1, 16 };
+	int nsizes = 2;
+	if(argc > 1) {
+		nsizes = 0;
+		for(int i = 1; i < argc && i <= 16; i++)
+			sizes[nsizes++] = atol(argv[i]);
+	}
+	for(int i = 0; i < nsizes; i++) {
+		if(sizes[i] < 1 || sizes[i] > 1024)
+			die("sizes are in MB, from 1 to 1024");
+		size_t size = sizes[i] << 20;
+		char *buf = malloc(size);
+		if(buf == NULL)
+			die("out of memory for %zu byte input", size);
+		gen_random(buf, size);
+		for(int j = 0; j < PATTERNS; j++)
+			bench(&corpus[j], "random", buf, size);
+		gen_log(buf, size);
+		for(int j = 0; j < PATTERNS; j++)
+			bench(&corpus[j], "log", buf, size);
+		free(buf);
+	}
+	return 0;
+}
@@ -0,0 +1,102 @@
+// construction scalability benchmark, sweeps parametric pattern families through parse() and label()
+// build: cc -O2 -pthread -o bench_build bench_build.c
+// usage: bench_build [max n] [timeout seconds] [threads] [max states]    (defaults to 16, 60, 1 and no limit)
+// output is one JSON object per line, one line per family and n
+#define _GNU_SOURCE
+#define REGDX_NO_MAIN
+#include "regdx6.c"
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#if 1 // families
+// each family writes its pattern of size n into buf
+// (a|b)*a(a|b){n}, the classic exponential blowup, {n} is expanded by hand
+void blowup(char *buf, int n) {
+	buf += sprintf(buf, "(a|b)*a");
+	for(int i = 0; i < n; i++)
+		buf += sprintf(buf, "(a|b)");
+}
+// n-way alternation of distinct literal words
+void alternation(char *buf, int n) {
+	for(int i = 0; i < n; i++)
+		buf += sprintf(buf, "%sw%c%c%c", i > 0 ? "|" : "", 'a' + i % 26, 'a' + i / 26 % 26, 'a' + i / 676 % 26);
+}
+// nested intersections and complements, every other level is negated
+void intersection(char *buf, int n) {
+	for(int i = 0; i < n; i++)
+		buf += sprintf(buf, "(.*%c.*&(", 'a' + i % 26);
+	buf += sprintf(buf, "[a-z]*");
+	for(int i = n - 1; i >= 0; i--)
+		buf += sprintf(buf, ")%s)", i % 2 ? "!" : "");
+}
+// one long Seq chain of single characters
+void chain(char *buf, int n) {
+	for(int i = 0; i < n; i++)
+		*buf++ = 'a' + i % 26;
+	*buf = '\0';
+}
+struct family {
+	char *name;
+	void (*make)(char *buf, int n);
+	int scale; // n is multiplied by this, so cheap families get swept further
+} families[] = {
+	{ "blowup", blowup, 1 },
+	{ "alternation", alternation, 32 },
+	{ "intersection", intersection, 1 },
+	{ "chain", chain, 64 },
+};
+#define FAMILIES (sizeof(families) / sizeof(families[0]))
+#endif
+double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+// each point gets its own child, so a timeout only kills that point and its peak rss is its own
+// returns false if the point failed, so the sweep can stop growing that family
+bool point(struct family *f, int n, int timeout) {
+	static char buf[1 << 20];
+	f->make(buf, n * f->scale);
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid < 0)
+		die("fork failed");
+	if(pid == 0) {
+		alarm(timeout);
+		double start = now();
+		Context *c = context_new(&names);
+		Reg r = parse(&names, buf);
+		double parsed = now();
+		bool built = label(c, r);
+		double labelled = now();
+		struct rusage ru;
+		getrusage(RUSAGE_SELF, &ru);
+		printf("{\"family\":\"%s\",\"n\":%i,\"pattern_bytes\":%zu,\"parse_s\":%.6f,\"label_s\":%.6f,\"wall_s\":%.6f,"
+			"\"lookups\":%li,\"nodes\":%li,\"states\":%i,\"peak_rss_kb\":%li,\"threads\":%i,\"fallback\":",
+			f->name, n * f->scale, strlen(buf), parsed - start, labelled - parsed, labelled - start,
+			stats.lookups, stats.created, c->nstates, ru.ru_maxrss, jobs);
+		printf(built ? "null}\n" : "\"%s\"}\n", c->over); // the budget it ran out of
+		exit(0);
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		return true;
+	printf("{\"family\":\"%s\",\"n\":%i,\"pattern_bytes\":%zu,\"error\":\"%s\"}\n", f->name, n * f->scale, strlen(buf),
+		WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM ? "timeout" : WIFSIGNALED(status) ? "crashed" : "died");
+	return false;
+}
+int main(int argc, char *argv[]) {
+	int max = argc > 1 ? atoi(argv[1]) : 16;
+	int timeout = argc > 2 ? atoi(argv[2]) : 60;
+	jobs = argc > 3 ? atoi(argv[3]) : 1;
+	budget.states = argc > 4 ? atol(argv[4]) : 0;
+	if(jobs < 1)
+		die("need at least 1 thread");
+	for(int i = 0; i < FAMILIES; i++)
+		for(int n = 1; n <= max; n++)
+			if(!point(&families[i], n, timeout))
+				break;
+	return 0;
+}
@@ -0,0 +1,329 @@
+// parallel grep over files and directory trees, using the unanchored search mode
+// build: cc -O2 -pthread -o rdgrep grep.c
+// usage: rdgrep [-n] [-c] [-l] [-o] [-e] [-j threads] [-p profile] <re> [path]...    (reads stdin with no paths)
+// a profile from regdx profile with the same regex lays the table out for the input it saw
+// every line with a match anywhere in it is printed, prefixed by its file when there
+// could be more than one, and files always come out in the order they were walked
+// like grep it exits with 0 if a line matched, 1 if none did, and 2 if a path couldn't be read
+#define _GNU_SOURCE
+#define REGDX_NO_MAIN
+#include "regdx6.c"
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+bool numbers = false, counts = false, names_only = false, only = false, earliest = false, prefix = false;
+bool failed = false; // some path couldn't be read, set from any worker
+#if 1 // walk
+// every file to scan, in output order
+char **paths;
+size_t npaths = 0, paths_cap = 0;
+void add_path(char *path) {
+	if(npaths == paths_cap) {
+		paths_cap = paths_cap ? paths_cap * 2 : 1024;
+		paths = realloc(paths, sizeof(char *) * paths_cap);
+		if(paths == NULL)
+			die("out of memory for paths");
+	}
+	paths[npaths++] = strdup(path);
+}
+// add every regular file under a directory, symlinks inside it are skipped
+// so a link back up the tree can't loop forever
+void walk(char *path) {
+	DIR *dir = opendir(path);
+	if(dir == NULL) {
+		fprintf(stderr, "rdgrep: %s: can't open directory\n", path);
+		failed = true;
+		return;
+	}
+	size_t len = strlen(path);
+	struct dirent *e;
+	while((e = readdir(dir)) != NULL) {
+		if(strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+			continue;
+		char *sub = malloc(len + strlen(e->d_name) + 2);
+		sprintf(sub, "%s%s%s", path, len > 0 && path[len - 1] == '/' ? "" : "/", e->d_name);
+		// d_type saves a stat per file when the filesystem fills it in
+		int type = e->d_type;
+		struct stat st;
+		if(type == DT_UNKNOWN && lstat(sub, &st) == 0)
+			type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+		if(type == DT_REG)
+			add_path(sub);
+		else if(type == DT_DIR)
+			walk(sub);
+		free(sub);
+	}
+	closedir(dir);
+}
+#endif
+#if 1 // output
+// each thread formats into its own buffer, which is handed to emit() once a file is done
+struct out {
+	char *buf;
+	size_t len, cap;
+};
+__thread struct out out;
+__thread char *current; // file being scanned, for prefixes
+__thread size_t lineno;
+void put(char *s, size_t n) {
+	if(out.len + n > out.cap) {
+		out.cap = (out.len + n) * 2;
+		out.buf = realloc(out.buf, out.cap);
+		if(out.buf == NULL)
+			die("out of memory for output");
+	}
+	memcpy(&out.buf[out.len], s, n);
+	out.len += n;
+}
+void putf(char *fmt, ...) {
+	char buf[64];
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	put(buf, n);
+}
+void put_prefix() {
+	if(prefix) {
+		put(current, strlen(current));
+		put(":", 1);
+	}
+	if(numbers)
+		putf("%zu:", lineno);
+}
+// files finish in any order, but are written in walk order. whatever finishes
+// ahead of the next file to write is parked until that file is written
+struct parked {
+	char *buf;
+	size_t len;
+	bool done;
+} *parked;
+size_t next_out = 0;
+Lock out_lock;
+void emit(size_t i) {
+	lock(&out_lock);
+	if(i != next_out) {
+		parked[i].buf = out.len ? malloc(out.len) : NULL;
+		if(out.len && parked[i].buf == NULL)
+			die("out of memory for parked output");
+		memcpy(parked[i].buf, out.buf, out.len);
+		parked[i].len = out.len;
+		parked[i].done = true;
+	} else {
+		fwrite(out.buf, 1, out.len, stdout);
+		for(next_out++; next_out < npaths && parked[next_out].done; next_out++) {
+			fwrite(parked[next_out].buf, 1, parked[next_out].len, stdout);
+			free(parked[next_out].buf);
+		}
+	}
+	unlock(&out_lock);
+	out.len = 0;
+}
+#endif
+#if 1 // scan
+void put_match(char *s, size_t start, size_t end) {
+	put_prefix();
+	put(s + start, end - start);
+	put("\n", 1);
+}
+// scan one file already in memory, returns the number of matching lines
+// lines are searched LINES at a time, which hides table latency, see search_batch()
+#define LINES 64
+long scan_buf(Finder *f, char *buf, size_t size) {
+	long count = 0;
+	char *line[LINES];
+	size_t len[LINES];
+	bool hit[LINES];
+	lineno = 0;
+	for(char *s = buf, *end = buf + size; s < end && !(names_only && count > 0);) {
+		int n = 0;
+		for(; n < LINES && s < end; n++) {
+			char *nl = memchr(s, '\n', end - s);
+			if(nl == NULL)
+				nl = end;
+			line[n] = s;
+			len[n] = nl - s;
+			s = nl + 1;
+		}
+		search_batch(f, line, len, n, hit);
+		for(int i = 0; i < n; i++) {
+			lineno++;
+			if(!hit[i])
+				continue;
+			count++;
+			if(names_only)
+				break;
+			if(only)
+				find_all(f, line[i], len[i], earliest, put_match);
+			else if(!counts) {
+				put_prefix();
+				put(line[i], len[i]);
+				put("\n", 1);
+			}
+		}
+	}
+	if(names_only && count > 0) {
+		put(current, strlen(current));
+		put("\n", 1);
+	} else if(counts) {
+		if(prefix) {
+			put(current, strlen(current));
+			put(":", 1);
+		}
+		putf("%li\n", count);
+	}
+	return count;
+}
+long scan_file(Finder *f, char *path) {
+	current = path;
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "rdgrep: %s: can't open\n", path);
+		__atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+		if(fd >= 0)
+			close(fd);
+		return 0;
+	}
+	long count = 0;
+	if(st.st_size == 0) {
+		count = scan_buf(f, NULL, 0);
+	} else {
+		char *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(buf == MAP_FAILED) {
+			fprintf(stderr, "rdgrep: %s: can't map\n", path);
+			__atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+		} else {
+			madvise(buf, st.st_size, MADV_SEQUENTIAL);
+			count = scan_buf(f, buf, st.st_size);
+			munmap(buf, st.st_size);
+		}
+	}
+	close(fd);
+	return count;
+}
+#endif
+#if 1 // pool
+// each worker owns a contiguous range of files and takes from its front, so a worker
+// mostly writes files in order. one that runs dry steals the back half of another's range
+struct range {
+	Lock lock;
+	size_t lo, hi;
+} *ranges;
+bool take(int me, size_t *file) {
+	struct range *own = &ranges[me];
+	lock(&own->lock);
+	bool got = own->lo < own->hi;
+	if(got)
+		*file = own->lo++;
+	unlock(&own->lock);
+	if(got)
+		return true;
+	for(int i = 1; i < jobs; i++) {
+		struct range *victim = &ranges[(me + i) % jobs];
+		lock(&victim->lock);
+		size_t lo = victim->lo, hi = victim->hi;
+		if(lo < hi)
+			victim->hi = lo + (hi - lo) / 2;
+		unlock(&victim->lock);
+		if(lo >= hi)
+			continue;
+		lo += (hi - lo) / 2;
+		lock(&own->lock);
+		own->lo = lo + 1;
+		own->hi = hi;
+		unlock(&own->lock);
+		*file = lo;
+		return true;
+	}
+	return false;
+}
+Finder *shared;
+long matched = 0;
+void *worker(void *arg) {
+	int me = (intptr_t)arg;
+	// the table is only read, the finder is copied for its own -o scratch, and a lazy
+	// table is copied too since reading one fills it in
+	Finder f = *shared;
+	f.t = table_copy(shared->t);
+	f.starts = NULL;
+	f.seen = NULL;
+	f.cap = 0;
+	long count = 0;
+	size_t i;
+	while(take(me, &i)) {
+		count += scan_file(&f, paths[i]) > 0;
+		emit(i);
+	}
+	free(f.starts);
+	free(f.seen);
+	free(out.buf);
+	__atomic_add_fetch(&matched, count, __ATOMIC_RELAXED);
+	return NULL;
+}
+#endif
+int main(int argc, char *argv[]) {
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	char *profile_path = NULL;
+	while((opt = getopt(argc, argv, "+ncloej:p:")) != -1)
+		switch(opt) {
+			case 'n': numbers = true; break;
+			case 'c': counts = true; break;
+			case 'l': names_only = true; break;
+			case 'o': only = true; break;
+			case 'e': earliest = true; break;
+			case 'j': jobs = atoi(optarg); break;
+			case 'p': profile_path = optarg; break;
+			default: die("usage: rdgrep [-n] [-c] [-l] [-o] [-e] [-j threads] [-p profile] <re> [path]...");
+		}
+	if(optind >= argc)
+		die("need a regex");
+	if(jobs < 1)
+		die("need at least 1 thread");
+	if(profile_path != NULL) // once the regex is known
+		profile_load(profile_path, argv[optind]);
+	shared = finder(context_new(&names), parse(&names, argv[optind++]));
+	if(optind == argc) {
+		// stdin is read whole and scanned like a single file
+		size_t len = 0, cap = 1 << 16;
+		char *buf = malloc(cap);
+		for(size_t n; buf != NULL && (n = fread(&buf[len], 1, cap - len, stdin)) > 0;)
+			if((len += n) == cap)
+				buf = realloc(buf, cap *= 2);
+		if(buf == NULL)
+			die("out of memory for stdin");
+		current = "(standard input)";
+		long count = scan_buf(shared, buf, len);
+		fwrite(out.buf, 1, out.len, stdout);
+		return count > 0 ? 0 : 1;
+	}
+	prefix = argc - optind > 1;
+	for(int i = optind; i < argc; i++) {
+		struct stat st;
+		if(stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+			prefix = true;
+			walk(argv[i]);
+		} else {
+			add_path(argv[i]); // scan_file() complains if it can't be read
+		}
+	}
+	parked = calloc(npaths + 1, sizeof(struct parked));
+	ranges = calloc(jobs, sizeof(struct range));
+	pthread_t *workers = malloc(sizeof(pthread_t) * jobs);
+	if(parked == NULL || ranges == NULL || workers == NULL)
+		die("out of memory for workers");
+	for(int i = 0; i < jobs; i++) {
+		ranges[i].lo = npaths * i / jobs;
+		ranges[i].hi = npaths * (i + 1) / jobs;
+	}
+	for(int i = 0; i < jobs; i++)
+		if(pthread_create(&workers[i], NULL, worker, (void *)(intptr_t)i) != 0)
+			die("can't start worker %i", i);
+	for(int i = 0; i < jobs; i++)
+		pthread_join(workers[i], NULL);
+	return failed ? 2 : matched > 0 ? 0 : 1;
+}
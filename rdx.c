@@ -0,0 +1,330 @@
+// the library behind rdx.h, the engine is regdx6.c with its main() left out
+// build: make librdx.a librdx.so
+// every handle shares the one hash-consed node store, so a later pattern reuses whatever
+// nodes and derivatives an earlier one made, but each thread labels in its own context,
+// so any number of threads can compile at once. now and then a compile stops the others
+// and collects every node no handle needs, so a process that compiles pattern after
+// pattern stays the same size
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include "rdx.h"
+// a failed compile or match gives up on itself instead of the process, by jumping back
+// out of rdx_compile() or whichever rdx_match() or rdx_scan() it was. anything that dies
+// outside of those still exits
+__thread jmp_buf *rdx_trap;
+__thread char rdx_why[256];
+#define die(...) do { \
+		snprintf(rdx_why, sizeof(rdx_why), __VA_ARGS__); \
+		if(rdx_trap != NULL) \
+			longjmp(*rdx_trap, 1); \
+		fprintf(stderr, "PANIC: %s\n", rdx_why); \
+		exit(-1); \
+	} while(0)
+#define REGDX_NO_MAIN
+#include "regdx6.c"
+struct rdx_dfa {
+	Table *t;
+	Finder *f; // only for RDX_SEARCH
+	int start; // row rdx_scan() starts from
+	Lock lock; // held while a lazy table is read, since reading fills it in
+	Names names; // its marks, numbered from 0 like any other pattern's
+};
+// each thread's context, reset for every compile so a table only has its own pattern's
+// states, and freed when the thread exits
+pthread_key_t contexts;
+// held to read while compiling or reading a lazy table, which both make nodes, and to
+// write while collecting. writers go first, so a stream of compiles can't starve one
+pthread_rwlock_t nodes;
+// every live lazy table, a handle's or a stream's, whose rows are the only roots, see
+// collect_nodes()
+Table **lazies;
+int nlazies = 0, lazies_cap = 0;
+Lock lazies_lock;
+pthread_once_t ready = PTHREAD_ONCE_INIT;
+void contexts_free(void *c) {
+	context_free(c);
+	free(operands); // the thread's parse stack, see parse_list()
+}
+void get_ready() {
+	pthread_rwlockattr_t attr;
+	pthread_rwlockattr_init(&attr);
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	if(pthread_key_create(&contexts, contexts_free) != 0 || pthread_rwlock_init(&nodes, &attr) != 0)
+		die("can't set up the library");
+	pthread_rwlockattr_destroy(&attr);
+}
+// the other threads' contexts aren't roots, since a compile resets its context first
+void collect_nodes() {
+	pthread_rwlock_wrlock(&nodes);
+	if(collect_due()) { // unless another thread just did
+		lock(&lazies_lock);
+		long n = 0;
+		for(int i = 0; i < nlazies; i++)
+			n += lazies[i]->states;
+		Reg *roots = malloc(sizeof(Reg) * (n + 1));
+		if(roots == NULL)
+			die("out of memory for collecting");
+		n = 0;
+		for(int i = 0; i < nlazies; i++) {
+			memcpy(&roots[n], lazies[i]->rows, sizeof(Reg) * lazies[i]->states);
+			n += lazies[i]->states;
+		}
+		unlock(&lazies_lock);
+		collect(roots, n);
+		free(roots);
+	}
+	pthread_rwlock_unlock(&nodes);
+}
+// a lazy table holds onto its rows' nodes, so it's a root from before anything can collect them
+void lazy_add(Table *t) {
+	lock(&lazies_lock);
+	if(nlazies == lazies_cap) {
+		lazies_cap = lazies_cap ? lazies_cap * 2 : 16;
+		lazies = realloc(lazies, sizeof(Table *) * lazies_cap);
+		if(lazies == NULL)
+			die("out of memory for lazy tables");
+	}
+	lazies[nlazies++] = t;
+	unlock(&lazies_lock);
+}
+void lazy_remove(Table *t) {
+	lock(&lazies_lock);
+	for(int i = 0; i < nlazies; i++)
+		if(lazies[i] == t) {
+			lazies[i] = lazies[--nlazies];
+			break;
+		}
+	unlock(&lazies_lock);
+}
+rdx_dfa *rdx_compile_ex(const char *pattern, int flags, const rdx_limits *limits) {
+	rdx_dfa *d = calloc(1, sizeof(rdx_dfa));
+	char *copy = strdup(pattern); // parse() writes into its input
+	if(d == NULL || copy == NULL) {
+		free(d);
+		free(copy);
+		snprintf(rdx_why, sizeof(rdx_why), "out of memory for pattern");
+		return NULL;
+	}
+	pthread_once(&ready, get_ready);
+	pthread_rwlock_rdlock(&nodes);
+	jmp_buf trap;
+	if(setjmp(trap) != 0) {
+		// nodes made before the failure stay interned, they're only unreachable, but
+		// the context could be half way through a label(), so the next compile gets a new one
+		rdx_trap = NULL;
+		Context *c = pthread_getspecific(contexts);
+		if(c != NULL) {
+			pthread_setspecific(contexts, NULL);
+			context_free(c);
+		}
+		pthread_rwlock_unlock(&nodes);
+		free(copy);
+		names_free(&d->names);
+		free(d);
+		// running out of nodes is only for now, if there are dead ones to collect
+		if(collect_due())
+			collect_nodes();
+		return NULL;
+	}
+	rdx_trap = &trap;
+	Context *c = pthread_getspecific(contexts);
+	if(c == NULL) {
+		c = context_new(NULL);
+		pthread_setspecific(contexts, c);
+	}
+	context_reset(c);
+	c->names = &d->names;
+	c->budget = limits ? (struct budget){ limits->states, limits->nodes, limits->seconds } : (struct budget){ 0 };
+	Reg r = parse(&d->names, copy);
+	if(more())
+		die("unexpected %c", peek());
+	if(flags & RDX_SEARCH) {
+		d->f = finder(c, r);
+		d->t = d->f->t;
+		d->start = d->f->search;
+	} else {
+		d->t = export(c, r);
+		d->start = d->t->start;
+	}
+	rdx_trap = NULL;
+	free(copy);
+	if(d->t->lazy)
+		lazy_add(d->t);
+	pthread_rwlock_unlock(&nodes);
+	if(collect_due())
+		collect_nodes();
+	return d;
+}
+rdx_dfa *rdx_compile(const char *pattern, int flags) {
+	return rdx_compile_ex(pattern, flags, NULL);
+}
+const char *rdx_error(void) {
+	return rdx_why;
+}
+// a pattern that ran out of budget has a lazy table, which derives as it's read, so
+// one thread at a time matches with it. a packed table is only read, and needs no lock
+// a lazy table is read a piece at a time, letting go of the nodes in between, so a
+// collect can take back what its flushes forgot while a long input is still being read
+#define PIECE (1 << 16)
+void lazy_begin(const rdx_dfa *d) {
+	lock((Lock *)&d->lock);
+	pthread_rwlock_rdlock(&nodes);
+}
+void lazy_pause() {
+	pthread_rwlock_unlock(&nodes);
+	if(collect_due())
+		collect_nodes();
+	pthread_rwlock_rdlock(&nodes);
+}
+void lazy_end(const rdx_dfa *d) {
+	pthread_rwlock_unlock(&nodes);
+	unlock((Lock *)&d->lock);
+}
+// only a lazy table can fail, when deriving runs out of room. it could have been half way
+// through adding a row, so it forgets all but its roots, and the next match starts over
+void lazy_failed(const rdx_dfa *d) {
+	rdx_trap = NULL;
+	table_flush(d->t);
+	lazy_end(d);
+	if(collect_due())
+		collect_nodes();
+}
+int rdx_match(const rdx_dfa *d, const char *s, size_t len) {
+	if(!d->t->lazy)
+		return d->f ? search(d->f, (char *)s, len) : table_match(d->t, d->start, (char *)s, len);
+	lazy_begin(d);
+	jmp_buf trap;
+	if(setjmp(trap) != 0) {
+		lazy_failed(d);
+		return -1;
+	}
+	rdx_trap = &trap;
+	int st = d->start;
+	for(size_t at = 0; at < len; at += PIECE) {
+		if(at > 0)
+			lazy_pause();
+		st = table_walk(d->t, st, (char *)s + at, len - at < PIECE ? len - at : PIECE, d->f != NULL);
+	}
+	bool found = d->t->accept[st];
+	rdx_trap = NULL;
+	lazy_end(d);
+	return found;
+}
+long rdx_scan(const rdx_dfa *d, const char *s, size_t len, rdx_callback callback, void *ctx) {
+	struct stream st;
+	stream_init(&st, d->t, d->start, ctx);
+	if(!d->t->lazy) {
+		stream_feed(&st, (char *)s, len, callback);
+		return stream_finish(&st, callback);
+	}
+	lazy_begin(d);
+	jmp_buf trap;
+	if(setjmp(trap) != 0) {
+		lazy_failed(d);
+		return -2;
+	}
+	rdx_trap = &trap;
+	for(size_t at = 0; at < len; at += PIECE) {
+		if(at > 0)
+			lazy_pause();
+		stream_feed(&st, (char *)s + at, len - at < PIECE ? len - at : PIECE, callback);
+	}
+	long last = stream_finish(&st, callback);
+	rdx_trap = NULL;
+	lazy_end(d);
+	return last;
+}
+// a stream's state is a row, which another match on a lazy handle could flush between
+// feeds, so a stream over one reads a copy of the table of its own, see table_flush()
+struct rdx_stream {
+	Table *t; // the handle's, or the copy
+	struct stream st;
+	rdx_callback callback;
+	bool failed; // a feed ran out of room, so the state is gone
+};
+rdx_stream *rdx_stream_init(const rdx_dfa *d, rdx_callback callback, void *ctx) {
+	rdx_stream *s = calloc(1, sizeof(rdx_stream));
+	if(s == NULL) {
+		snprintf(rdx_why, sizeof(rdx_why), "out of memory for stream");
+		return NULL;
+	}
+	s->t = d->t;
+	s->callback = callback;
+	if(d->t->lazy) {
+		lazy_begin(d);
+		jmp_buf trap;
+		if(setjmp(trap) != 0) {
+			rdx_trap = NULL;
+			lazy_end(d);
+			free(s);
+			return NULL;
+		}
+		rdx_trap = &trap;
+		s->t = table_copy(d->t);
+		lazy_add(s->t);
+		rdx_trap = NULL;
+		lazy_end(d);
+	}
+	stream_init(&s->st, s->t, d->start, ctx);
+	return s;
+}
+int rdx_stream_feed(rdx_stream *s, const char *buf, size_t len) {
+	if(s->failed) {
+		snprintf(rdx_why, sizeof(rdx_why), "stream ran out of room before");
+		return -1;
+	}
+	if(!s->t->lazy) {
+		stream_feed(&s->st, (char *)buf, len, s->callback);
+		return 0;
+	}
+	pthread_rwlock_rdlock(&nodes);
+	jmp_buf trap;
+	if(setjmp(trap) != 0) {
+		rdx_trap = NULL;
+		s->failed = true;
+		table_flush(s->t); // it could have been half way through adding a row
+		pthread_rwlock_unlock(&nodes);
+		if(collect_due())
+			collect_nodes();
+		return -1;
+	}
+	rdx_trap = &trap;
+	for(size_t at = 0; at < len; at += PIECE) {
+		if(at > 0)
+			lazy_pause();
+		stream_feed(&s->st, (char *)buf + at, len - at < PIECE ? len - at : PIECE, s->callback);
+	}
+	rdx_trap = NULL;
+	pthread_rwlock_unlock(&nodes);
+	return 0;
+}
+long rdx_stream_finish(rdx_stream *s) {
+	long last = s->failed ? -2 : stream_finish(&s->st, s->callback);
+	if(s->failed)
+		snprintf(rdx_why, sizeof(rdx_why), "stream ran out of room before");
+	if(s->t->lazy) {
+		lazy_remove(s->t);
+		table_free(s->t);
+	}
+	free(s);
+	return last;
+}
+const char *rdx_mark_name(const rdx_dfa *d, int mark) {
+	return mark >= 0 && mark < d->names.n ? d->names.name[mark] : NULL;
+}
+void rdx_free(rdx_dfa *d) {
+	if(d == NULL)
+		return;
+	if(d->t->lazy)
+		lazy_remove(d->t);
+	table_free(d->t);
+	names_free(&d->names);
+	if(d->f != NULL) {
+		free(d->f->starts);
+		free(d->f->seen);
+		free(d->f);
+	}
+	free(d);
+}
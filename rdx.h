@@ -0,0 +1,58 @@
+// embeddable regdx, a pattern is compiled once into a handle that can then be matched
+// any number of times, from any number of threads, and patterns can be compiled on many
+// threads at once
+// build: make librdx.a librdx.so    (or include rdx.hpp from C++ for an owning wrapper)
+#ifndef RDX_H
+#define RDX_H
+#include <stdbool.h>
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+#define RDX_API __attribute__((visibility("default")))
+// flags for rdx_compile()
+#define RDX_ANCHORED (0) // rdx_match() is true when the whole input matches
+#define RDX_SEARCH (1) // rdx_match() is true when a match is anywhere in the input
+// the same as in regdx6.c, the mark given to the callback when a match ends
+#define RDX_MATCH (-1)
+typedef void (*rdx_callback)(void *ctx, int mark, size_t offset);
+typedef struct rdx_dfa rdx_dfa;
+typedef struct rdx_stream rdx_stream;
+// what one compile may build, 0 means no limit. a pattern past a limit still compiles,
+// into a handle that derives its states as it matches instead of all up front
+typedef struct rdx_limits {
+	long states; // in its DFA
+	long nodes; // regex nodes made building it
+	double seconds; // spent building it
+} rdx_limits;
+// NULL if the pattern has a syntax error or the engine is full, rdx_error() says which
+RDX_API rdx_dfa *rdx_compile(const char *pattern, int flags);
+// the same, with limits, which can be NULL for none
+RDX_API rdx_dfa *rdx_compile_ex(const char *pattern, int flags, const rdx_limits *limits);
+// why the last rdx_compile(), rdx_match() or rdx_scan() on this thread failed
+RDX_API const char *rdx_error(void);
+// 1 if s matches, 0 if it doesn't. a handle that went past its limits derives states as
+// it matches, and that can run out of room, which returns -1. the handle is still good
+RDX_API int rdx_match(const rdx_dfa *d, const char *s, size_t len);
+// gives every match end, and every mark entered, to the callback in input order
+// returns where the last match ended, -1 if none did, or -2 if it ran out of room like
+// rdx_match() can, after giving the callback whatever it found before then
+RDX_API long rdx_scan(const rdx_dfa *d, const char *s, size_t len, rdx_callback callback, void *ctx);
+// matching over data that arrives in pieces, like from a socket, which gives the callback
+// what rdx_scan() would over everything fed so far, without copying any of it. a stream
+// is for one thread at a time, but any number can share a handle, which has to outlive
+// them. NULL if there's no room for it, rdx_error() says why
+RDX_API rdx_stream *rdx_stream_init(const rdx_dfa *d, rdx_callback callback, void *ctx);
+// 0, or -1 if it ran out of room like rdx_match() can, after which every feed fails
+RDX_API int rdx_stream_feed(rdx_stream *s, const char *buf, size_t len);
+// gives the callback anything still to come and frees the stream. returns where the last
+// match ended, -1 if none did, or -2 if a feed failed
+RDX_API long rdx_stream_finish(rdx_stream *s);
+// the name between the backquotes of a mark given to the callback, NULL if d has no such
+// mark. a pattern's marks are numbered from 0 in the order they're written
+RDX_API const char *rdx_mark_name(const rdx_dfa *d, int mark);
+RDX_API void rdx_free(rdx_dfa *d);
+#ifdef __cplusplus
+}
+#endif
+#endif
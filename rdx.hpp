@@ -0,0 +1,81 @@
+// a move-only owner for an rdx_dfa, freed when it goes out of scope, and one for a stream
+// over it, see rdx.h
+// a pattern that doesn't compile, or a match that runs out of room, throws
+// std::runtime_error with rdx_error()'s reason
+#ifndef RDX_HPP
+#define RDX_HPP
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "rdx.h"
+namespace rdx {
+template<class F> void call(void *ctx, int mark, size_t offset) {
+	(*static_cast<F *>(ctx))(mark, offset);
+}
+class dfa {
+	rdx_dfa *d = nullptr;
+public:
+	dfa() = default;
+	explicit dfa(const std::string &pattern, int flags = RDX_ANCHORED, const rdx_limits *limits = nullptr)
+			: d(rdx_compile_ex(pattern.c_str(), flags, limits)) {
+		if(d == nullptr)
+			throw std::runtime_error(rdx_error());
+	}
+	dfa(const dfa &) = delete;
+	dfa &operator=(const dfa &) = delete;
+	dfa(dfa &&o) noexcept : d(std::exchange(o.d, nullptr)) {}
+	dfa &operator=(dfa &&o) noexcept {
+		std::swap(d, o.d);
+		return *this;
+	}
+	~dfa() { rdx_free(d); }
+	explicit operator bool() const { return d != nullptr; }
+	rdx_dfa *get() const { return d; }
+	bool match(std::string_view s) const {
+		int found = rdx_match(d, s.data(), s.size());
+		if(found < 0)
+			throw std::runtime_error(rdx_error());
+		return found;
+	}
+	// nullptr if there's no such mark, see rdx_mark_name()
+	const char *mark_name(int mark) const { return rdx_mark_name(d, mark); }
+	// each is called as each(mark, offset), see rdx_scan()
+	template<class F> long scan(std::string_view s, F &&each) const {
+		long last = rdx_scan(d, s.data(), s.size(), call<std::remove_reference_t<F>>, (void *)&each);
+		if(last == -2)
+			throw std::runtime_error(rdx_error());
+		return last;
+	}
+};
+// an rdx_stream calling each(mark, offset), finished when it goes out of scope if finish()
+// wasn't called. it's where the callback lives, so it can't be copied or moved
+template<class F> class stream {
+	F each;
+	rdx_stream *s;
+public:
+	stream(const dfa &d, F each) : each(std::move(each)), s(rdx_stream_init(d.get(), call<F>, &this->each)) {
+		if(s == nullptr)
+			throw std::runtime_error(rdx_error());
+	}
+	stream(const stream &) = delete;
+	stream &operator=(const stream &) = delete;
+	~stream() {
+		if(s != nullptr)
+			rdx_stream_finish(s);
+	}
+	void feed(std::string_view buf) {
+		if(rdx_stream_feed(s, buf.data(), buf.size()) < 0)
+			throw std::runtime_error(rdx_error());
+	}
+	// see rdx_stream_finish()
+	long finish() {
+		long last = rdx_stream_finish(std::exchange(s, nullptr));
+		if(last == -2)
+			throw std::runtime_error(rdx_error());
+		return last;
+	}
+};
+}
+#endif
@@ -3,201 +3,578 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <string.h>
-void die(char *s) { printf(s); exit(0); }
-/*#define die(...) do { \
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+// an embedder can define its own die() first, the library does, see rdx.c
+#ifndef die
+#define die(...) do { \
 		fprintf(stderr, "PANIC: "); \
 		fprintf(stderr, __VA_ARGS__); \
 		fprintf(stderr, "\n"); \
 		exit(-1); \
-	} while(0)*/
+	} while(0)
+#endif
 enum type { UNUSED = 0, EMPTY, ALL, NONE, LIT, MARK, INF, NOT, SEQ, OR, AND };
-struct reg {
-	enum type type; // what kind of node?
-	bool null; // does the regex match the empty string
-	union { // each type uses only one of these:
-		struct { struct reg *head, *tail; }; // types with children
-		struct { int ch, len; }; // lit
-		struct { char *name; }; // mark
-	};
-	struct reg *next[256]; // cache of derivitives for each byte
-	int id; // unique id for each state, 0 if undefined
-	bool done; // have we printed this state yet?
-};
-typedef struct reg Reg;
 typedef enum type Type;
+// a regex is a 32 bit index into the node arrays below, every regex exists exactly
+// once so equality is still ==, and 0 is never a node so it can mean "none yet"
+typedef uint32_t Reg;
+#define NIL (0)
+#define CACHE_SIZE (1 << 20)
+// nodes are stored as a structure of arrays, so the fields derive() and merge() look
+// at for many nodes share cache lines instead of each sitting in its own 100 byte struct
+struct tag { // type and flags, one byte per node
+	uint8_t type: 4; // what kind of node?
+	uint8_t null: 1; // does the regex match the empty string
+};
+union link { // children, 8 bytes per node, each type uses only one of these:
+	struct { Reg head, tail; }; // inf, not and seq
+	struct { uint32_t kids, n; }; // or and and, n children at pool[kids], sorted by id with no repeats
+	struct { uint32_t ch, len; }; // lit, and mark in ch
+};
+struct tag tags[CACHE_SIZE];
+union link links[CACHE_SIZE];
+uint32_t hashes[CACHE_SIZE]; // of the fields that make the node unique
+uint64_t bounds[CACHE_SIZE][4]; // bit c is set if a derivative class starts at byte c
+uint32_t cached[CACHE_SIZE]; // where the derivative of each class starts in derivs
+struct edge *edges[CACHE_SIZE]; // transitions out of each state, filled in by label()
+uint16_t nedges[CACHE_SIZE];
+uint32_t used = 1; // highest node id handed out so far plus 1, counting the unused node 0
+// ids collect() found dead, which alloc() hands out again before any new one
+Reg freed[CACHE_SIZE];
+uint32_t nfreed = 0;
+long handed = 0; // nodes alloc() has handed out since the last collect()
+__thread long made = 0; // nodes alloc() has handed out on this thread, ever, see made_by()
+long survived = 0; // nodes the last collect() kept
+// variable length data lives in two pools, carved out by bumping a counter
+#define POOL_SIZE (CACHE_SIZE * 8)
+Reg pool[POOL_SIZE]; // children of every OR and AND
+uint32_t pooled = 0;
+Reg derivs[POOL_SIZE]; // cache of derivitives for each class of each node, NIL until derived
+uint32_t nderivs = 0;
+// every byte from lo to hi goes to the same state
+struct edge {
+	uint8_t lo, hi;
+	Reg to;
+};
+#if 1 // classes
+// derivatives are computed per class of bytes rather than per byte, in the style of
+// owens, reppy and turon: a node's classes are the coarsest partition of 0..255 such
+// that its derivative is the same for every byte in a class, and are found by
+// intersecting the partitions of whatever derive() would look at
+void bound(Reg r, uint ch) {
+	if(ch < 256)
+		bounds[r][ch / 64] |= 1ULL << ch % 64;
+}
+void bounds_of(Reg r, Reg from) {
+	for(int i = 0; i < 4; i++)
+		bounds[r][i] |= bounds[from][i];
+}
+Reg *children(Reg r) {
+	return &pool[links[r].kids];
+}
+int classes(Reg r) {
+	int n = 0;
+	for(int i = 0; i < 4; i++)
+		n += __builtin_popcountll(bounds[r][i]);
+	return n;
+}
+void full(uint32_t h, char *what);
+// only called while making a node, whose hash h says which stripe to unlock if it fails
+uint32_t reserve(uint32_t *top, uint32_t n, uint32_t h, char *what) {
+	uint32_t at = __atomic_fetch_add(top, n, __ATOMIC_RELAXED);
+	if(at + n > POOL_SIZE)
+		full(h, what);
+	return at;
+}
+// fill in bounds and the derivative cache, the children must already be done
+void classify(Reg r) {
+	bound(r, 0);
+	switch(tags[r].type) {
+		case LIT:
+			bound(r, links[r].ch);
+			bound(r, links[r].ch + links[r].len);
+		break;
+		case INF:
+		case NOT:
+			bounds_of(r, links[r].head);
+		break;
+		case SEQ:
+			bounds_of(r, links[r].head);
+			if(tags[links[r].head].null)
+				bounds_of(r, links[r].tail);
+		break;
+		case OR:
+		case AND:
+			for(int i = 0; i < links[r].n; i++)
+				bounds_of(r, children(r)[i]);
+		break;
+		default:
+		break;
+	}
+	// leaves are derived on the spot, only nodes with children cache their derivatives
+	if(tags[r].type >= INF)
+		cached[r] = reserve(&nderivs, classes(r), hashes[r], "derivative cache");
+}
+// which class ch falls in
+int class_of(Reg r, uint ch) {
+	int k = 0;
+	for(int i = 0; i < ch / 64; i++)
+		k += __builtin_popcountll(bounds[r][i]);
+	return k + __builtin_popcountll(bounds[r][ch / 64] & ((2ULL << ch % 64) - 1)) - 1;
+}
+// first byte at or after ch that starts a class, 256 if there isn't one
+int next_bound(Reg r, uint ch) {
+	for(; ch < 256; ch = (ch | 63) + 1) {
+		uint64_t rest = bounds[r][ch / 64] >> ch % 64;
+		if(rest != 0)
+			return ch + __builtin_ctzll(rest);
+	}
+	return 256;
+}
+#endif
 #if 1 // allocation
-#define CACHE_SIZE (50000)
-Reg *make0(Type type, uint ch, uint len) {
-	static Reg cache[CACHE_SIZE];
-	for(uint i = 0; i < CACHE_SIZE; i++) {
-		Reg *r = &cache[i];
-		if(r->type == type && r->ch == ch && r->len == len)
-			return r;
-		if(r->type == UNUSED) {
-			r->type = type;
-			r->ch = ch;
-			r->len = len;
-			assert(type == LIT || type == MARK);
-			if(type == LIT)
-				r->null = false;
-			else
-				r->null = true;
-			return r;
+// construction counters, read by the benchmarks and --stats
+// build with -DNO_STATS to compile every counter out
+// each thread counts into its own copy, label() sums the workers' back into the caller's
+struct stats {
+	long lookups; // calls into make0/1/2/N
+	long created; // nodes actually allocated by them
+	long types[AND + 1]; // nodes created of each type
+	long probes; // hash table slots looked at by make0/1/2/N
+	long max_probe; // most slots looked at by a single lookup
+	long hits, misses; // derive() answered from derivs, or computed
+	long merges; // calls to merge() and join()
+	long widest; // most children of any OR or AND
+	long labelled; // states labelled
+	long bytes; // bytes allocated, nodes count as their share of every array
+	long fallbacks; // label() calls that ran out of budget, see budget
+	long collected; // nodes freed by collect()
+};
+__thread struct stats stats;
+#ifndef NO_STATS
+#define STAT(...) do { __VA_ARGS__; } while(0)
+#else
+#define STAT(...) do { } while(0)
+#endif
+void probed(long n) {
+	stats.probes += n;
+	if(n > stats.max_probe)
+		stats.max_probe = n;
+}
+void created(Type type) {
+	stats.created++;
+	stats.types[type]++;
+	stats.bytes += sizeof(struct tag) + sizeof(union link) + sizeof(hashes[0]) + sizeof(bounds[0])
+		+ sizeof(cached[0]) + sizeof(int) + sizeof(edges[0]) + sizeof(nedges[0]);
+}
+void classified(Reg r) {
+	if(tags[r].type >= INF)
+		stats.bytes += sizeof(Reg) * classes(r);
+}
+void stats_add(struct stats *into, struct stats *from) {
+	into->lookups += from->lookups;
+	into->created += from->created;
+	for(int i = 0; i <= AND; i++)
+		into->types[i] += from->types[i];
+	into->probes += from->probes;
+	into->max_probe = into->max_probe > from->max_probe ? into->max_probe : from->max_probe;
+	into->hits += from->hits;
+	into->misses += from->misses;
+	into->merges += from->merges;
+	into->widest = into->widest > from->widest ? into->widest : from->widest;
+	into->labelled += from->labelled;
+	into->bytes += from->bytes;
+	into->fallbacks += from->fallbacks;
+	into->collected += from->collected;
+}
+// nodes are found by hashing into a table of ids split into STRIPES independent open
+// addressing tables, each with its own lock. a key always hashes to the same stripe,
+// so make0/1/2/N can be called from many threads at once
+#define STRIPES (64)
+#define TABLE_SIZE (CACHE_SIZE * 2)
+#define STRIPE_SIZE (TABLE_SIZE / STRIPES)
+typedef char Lock;
+void lock(Lock *l) {
+	while(__atomic_test_and_set(l, __ATOMIC_ACQUIRE))
+		sched_yield(); // held only for a probe, so just get out of the holder's way
+}
+void unlock(Lock *l) {
+	__atomic_clear(l, __ATOMIC_RELEASE);
+}
+uint32_t hash(uint64_t a, uint64_t b, uint64_t c) {
+	uint64_t h = (a + 1) * 0x9E3779B97F4A7C15ULL;
+	h = (h ^ b) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ c) * 0x94D049BB133111EBULL;
+	return h ^ h >> 32;
+}
+Reg slots[TABLE_SIZE];
+Lock locks[STRIPES];
+// give up on making a node, with its stripe still locked. the library's die() doesn't
+// exit, so the stripe is unlocked first or the next make to hash into it spins forever
+// a node alloc() handed out is left out of the table, and collect() frees it
+void full(uint32_t h, char *what) {
+	unlock(&locks[h % STRIPES]);
+	die("out of %s", what);
+}
+// find the slot holding the node of this type with these children, or the empty
+// slot it belongs in. the stripe is left locked for the caller to fill the slot
+// kids is only given for OR and AND, where link holds just the count
+Reg *probe(uint32_t h, Type type, union link link, Reg *kids) {
+	Reg *stripe = &slots[h % STRIPES * STRIPE_SIZE];
+	lock(&locks[h % STRIPES]);
+	for(uint i = 0; i < STRIPE_SIZE; i++) {
+		Reg *slot = &stripe[(h / STRIPES + i) % STRIPE_SIZE];
+		Reg r = *slot;
+		// comparing hashes first means a mismatch almost never looks at the children
+		if(r == NIL || (tags[r].type == type && hashes[r] == h && (kids == NULL
+				? links[r].head == link.head && links[r].tail == link.tail
+				: links[r].n == link.n && memcmp(children(r), kids, sizeof(Reg) * link.n) == 0))) {
+			STAT(probed(i + 1));
+			return slot;
 		}
 	}
-	die("out of pair nodes");
+	full(h, "nodes");
+	return NULL;
 }
-Reg *make1(Type type, Reg *head) {
-	static Reg cache[CACHE_SIZE];
-	for(uint i = 0; i < CACHE_SIZE; i++) {
-		Reg *r = &cache[i];
-		if(r->type == type && r->head == head)
-			return r;
-		if(r->type == UNUSED) {
-			r->type = type;
-			r->head = head;
-			assert(type == NOT || type == INF);
-			if(type == NOT)
-				r->null = !head->null;
-			else
-				r->null = true;
-			return r;
-		}
+// hand out a fresh node, only called with its stripe locked
+Reg alloc(Type type, uint32_t h) {
+	long n = __atomic_fetch_add(&handed, 1, __ATOMIC_RELAXED);
+	made++;
+	Reg r = n < nfreed ? freed[n] : __atomic_fetch_add(&used, 1, __ATOMIC_RELAXED);
+	if(r >= CACHE_SIZE)
+		full(h, "nodes");
+	STAT(created(type));
+	tags[r].type = type;
+	hashes[r] = h;
+	return r;
+}
+Reg make0(Type type, uint ch, uint len) {
+	STAT(stats.lookups++);
+	uint32_t h = hash(type, ch, len);
+	Reg *slot = probe(h, type, (union link){ .ch = ch, .len = len }, NULL);
+	Reg r = *slot;
+	if(r == NIL) {
+		r = alloc(type, h);
+		links[r].ch = ch;
+		links[r].len = len;
+		assert(type == LIT || type == MARK || type == EMPTY || type == ALL || type == NONE);
+		tags[r].null = type == MARK || type == EMPTY || type == ALL;
+		classify(r);
+		STAT(classified(r));
+		*slot = r;
 	}
-	die("out of pair nodes");
+	unlock(&locks[h % STRIPES]);
+	return r;
 }
-Reg *make2(Type type, Reg *head, Reg *tail) {
-	static Reg cache[CACHE_SIZE];
-	for(uint i = 0; i < CACHE_SIZE; i++) {
-		Reg *r = &cache[i];
-		if(r->type == type && r->head == head && r->tail == tail)
-			return r;
-		if(r->type == UNUSED) {
-			r->type = type;
-			r->head = head;
-			r->tail = tail;
-			assert(type == SEQ || type == OR || type == AND);
-			if(type == SEQ || type == AND)
-				r->null = head->null && tail->null;
-			else
-				r->null = head->null || tail->null;
-			return r;
-		}
+Reg make1(Type type, Reg head) {
+	STAT(stats.lookups++);
+	uint32_t h = hash(type, head, 0);
+	Reg *slot = probe(h, type, (union link){ .head = head, .tail = NIL }, NULL);
+	Reg r = *slot;
+	if(r == NIL) {
+		r = alloc(type, h);
+		links[r].head = head;
+		links[r].tail = NIL;
+		assert(type == NOT || type == INF);
+		if(type == NOT)
+			tags[r].null = !tags[head].null;
+		else
+			tags[r].null = true;
+		classify(r);
+		STAT(classified(r));
+		*slot = r;
 	}
-	die("out of pair nodes");
+	unlock(&locks[h % STRIPES]);
+	return r;
+}
+Reg make2(Type type, Reg head, Reg tail) {
+	STAT(stats.lookups++);
+	uint32_t h = hash(type, head, tail);
+	Reg *slot = probe(h, type, (union link){ .head = head, .tail = tail }, NULL);
+	Reg r = *slot;
+	if(r == NIL) {
+		r = alloc(type, h);
+		links[r].head = head;
+		links[r].tail = tail;
+		assert(type == SEQ);
+		tags[r].null = tags[head].null && tags[tail].null;
+		classify(r);
+		STAT(classified(r));
+		*slot = r;
+	}
+	unlock(&locks[h % STRIPES]);
+	return r;
+}
+// kids must already be sorted and free of repeats, they're copied if the node is new
+Reg makeN(Type type, Reg *kids, int n) {
+	STAT(stats.lookups++);
+	uint32_t h = hash(type, n, 0);
+	for(int i = 0; i < n; i++)
+		h = hash(h, kids[i], 0);
+	Reg *slot = probe(h, type, (union link){ .kids = 0, .n = n }, kids);
+	Reg r = *slot;
+	if(r == NIL) {
+		r = alloc(type, h);
+		STAT(stats.bytes += sizeof(Reg) * n, stats.widest = n > stats.widest ? n : stats.widest);
+		links[r].kids = reserve(&pooled, n, h, "list children");
+		links[r].n = n;
+		memcpy(children(r), kids, sizeof(Reg) * n);
+		assert(type == OR || type == AND);
+		tags[r].null = type == AND;
+		for(int j = 0; j < n; j++)
+			if(tags[kids[j]].null != tags[r].null) {
+				tags[r].null = !tags[r].null;
+				break;
+			}
+		classify(r);
+		STAT(classified(r));
+		*slot = r;
+	}
+	unlock(&locks[h % STRIPES]);
+	return r;
+}
+#endif
+#if 1 // tracing
+// nested spans in the chrome about:tracing / perfetto JSON format, one lane per thread
+// nothing is recorded unless --trace is given, build with -DNO_TRACE to compile them out
+struct event {
+	char *name;
+	char phase; // 'B' begins a span, 'E' ends the innermost one
+	int tid;
+	long ns;
+};
+#define TRACE_SIZE (1 << 20)
+struct event *events = NULL; // NULL when tracing is off
+long nevents = 0;
+char *trace_path = NULL;
+int lanes = 0;
+__thread int tid = 0; // lane for this thread, 0 until its first event
+void trace(char *name, char phase) {
+	long i = __atomic_fetch_add(&nevents, 1, __ATOMIC_RELAXED);
+	if(i >= TRACE_SIZE) // drop anything past the end of the buffer
+		return;
+	if(tid == 0)
+		tid = __atomic_add_fetch(&lanes, 1, __ATOMIC_RELAXED);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	events[i] = (struct event){ name, phase, tid, ts.tv_sec * 1000000000L + ts.tv_nsec };
+}
+#ifndef NO_TRACE
+#define TRACE_BEGIN(name) do { if(events != NULL) trace(name, 'B'); } while(0)
+#define TRACE_END(name) do { if(events != NULL) trace(name, 'E'); } while(0)
+#else
+#define TRACE_BEGIN(name) do { } while(0)
+#define TRACE_END(name) do { } while(0)
+#endif
+void trace_start(char *path) {
+	trace_path = path;
+	events = malloc(sizeof(struct event) * TRACE_SIZE);
+	if(events == NULL)
+		die("out of memory for trace");
+}
+void trace_dump() {
+	FILE *f = fopen(trace_path, "w");
+	if(f == NULL)
+		die("can't write trace to %s", trace_path);
+	long n = nevents < TRACE_SIZE ? nevents : TRACE_SIZE, base = n > 0 ? events[0].ns : 0;
+	// a thread can claim a slot before another and read the clock after it, so the
+	// earliest event can be anywhere
+	for(long i = 1; i < n; i++)
+		base = events[i].ns < base ? events[i].ns : base;
+	fprintf(f, "{\"traceEvents\":[\n");
+	for(long i = 0; i < n; i++)
+		fprintf(f, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%i}%s\n",
+			events[i].name, events[i].phase, (events[i].ns - base) / 1000.0, events[i].tid, i + 1 < n ? "," : "");
+	fprintf(f, "],\"displayTimeUnit\":\"ns\"}\n");
+	fclose(f);
 }
 #endif
 #if 1 // merging
-void print(Reg *x);
-Reg *merge(Type type, Reg *head, Reg *tail);
-Reg *merge_one(Type type, Reg *head, Reg *tail) {
-	//printf("MERGE ONE %s ", type == SEQ ? "SEQ" : type == AND ? "AND" : "OR");
-	//print(head);
-	//printf(" WITH ");
-	//print(tail);
-	//printf(": ");
-	if(head < tail) { //printf("<LT>");
-		return make2(type, head, tail); }
-	if(tail < head) { //printf("<GT>");
-		return make2(type, tail, head); }
-	 { //printf("<EQ>");
-	return head; }
-}
-Reg *merge_single(Type type, Reg *head, Reg *tail) {
-	if(head < tail->head)
-		return make2(type, head, tail);
-	if(tail->head < head)
-		return make2(type, tail->head, merge(type, head, tail->tail));
-	return make2(type, head, tail->tail);
-}
-Reg *merge_pair(Type type, Reg *head, Reg *tail) {
-	if(head->head < tail->head)
-		return make2(type, head->head, merge(type, head->tail, tail));
-	if(tail->head < head->head)
-		return make2(type, tail->head, merge(type, head, tail->tail));
-	return make2(type, head->head, merge(type, head->tail, tail->tail));
-}
-Reg *merge(Type type, Reg *head, Reg *tail) {
-	if(head->type == type)
-		if(tail->type == type)
-			return merge_pair(type, head, tail);
+void print(Reg x);
+Reg Empty();
+Reg All();
+Reg None();
+// OR and AND are flat lists of children sorted by id, so they can be
+// unioned or intersected with one linear merge and interned as one node
+int by_id(const void *a, const void *b) {
+	Reg x = *(Reg *)a, y = *(Reg *)b;
+	return (x > y) - (x < y);
+}
+// the single result of a list with n children
+Reg list(Type type, Reg *kids, int n) {
+	if(n == 0)
+		return type == OR ? None() : All();
+	if(n == 1)
+		return kids[0];
+	return makeN(type, kids, n);
+}
+Reg merge(Type type, Reg head, Reg tail) {
+	STAT(stats.merges++);
+	Reg *a = tags[head].type == type ? children(head) : &head;
+	Reg *b = tags[tail].type == type ? children(tail) : &tail;
+	int an = tags[head].type == type ? links[head].n : 1;
+	int bn = tags[tail].type == type ? links[tail].n : 1;
+	Reg out[an + bn];
+	int i = 0, j = 0, n = 0;
+	while(i < an && j < bn)
+		if(a[i] < b[j])
+			out[n++] = a[i++];
+		else if(b[j] < a[i])
+			out[n++] = b[j++];
 		else
-			return merge_single(type, tail, head);
-	else
-		if(tail->type == type)
-			return merge_single(type, head, tail);
+			out[n++] = a[i++], j++;
+	while(i < an)
+		out[n++] = a[i++];
+	while(j < bn)
+		out[n++] = b[j++];
+	return list(type, out, n);
+}
+// OR or AND together any number of expressions at once
+Reg join(Type type, Reg *rs, int count) {
+	STAT(stats.merges++);
+	Reg absorb = type == OR ? All() : None(); // swallows the whole list
+	Reg identity = type == OR ? None() : All(); // can be dropped from it
+	int total = 0;
+	for(int i = 0; i < count; i++)
+		total += tags[rs[i]].type == type ? links[rs[i]].n : 1;
+	Reg out[total];
+	int n = 0;
+	for(int i = 0; i < count; i++) {
+		if(rs[i] == absorb)
+			return absorb;
+		if(rs[i] == identity)
+			continue;
+		if(tags[rs[i]].type == type)
+			for(int j = 0; j < links[rs[i]].n; j++)
+				out[n++] = children(rs[i])[j];
 		else
-			return merge_one(type, head, tail);
+			out[n++] = rs[i];
+	}
+	qsort(out, n, sizeof(Reg), by_id);
+	int kept = 0;
+	for(int i = 0; i < n; i++)
+		if(kept == 0 || out[kept - 1] != out[i])
+			out[kept++] = out[i];
+	return list(type, out, kept);
 }
-Reg *append(Type type, Reg *head, Reg *tail) {
-	if(head->type != type)
+Reg append(Type type, Reg head, Reg tail) {
+	if(tags[head].type != type)
 		return make2(type, head, tail);
 	else
-		return make2(type, head->head, append(type, head->tail, tail));
+		return make2(type, links[head].head, append(type, links[head].tail, tail));
 }
 #endif
 #if 1 // constructors
-Reg *Empty() {
-	static Reg cache;
-	cache.type = EMPTY;
-	cache.null = true;
-	return &cache;
-}
-Reg *All() {
-	static Reg cache;
-	cache.type = ALL;
-	cache.null = true;
-	return &cache;
-}
-Reg *None() {
-	static Reg cache;
-	cache.type = NONE;
-	cache.null = false;
-	return &cache;
-}
-Reg *Lit(uint ch, uint len) {
+// the leaves with no fields are interned like any other node, and their ids kept
+// in a static once made, since derive() and join() ask for them constantly
+Reg leaf(Reg *cache, Type type) {
+	Reg r = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+	if(r == NIL) {
+		r = make0(type, 0, 0);
+		__atomic_store_n(cache, r, __ATOMIC_RELEASE);
+	}
+	return r;
+}
+Reg Empty() {
+	static Reg cache = NIL;
+	return leaf(&cache, EMPTY);
+}
+Reg All() {
+	static Reg cache = NIL;
+	return leaf(&cache, ALL);
+}
+Reg None() {
+	static Reg cache = NIL;
+	return leaf(&cache, NONE);
+}
+Reg Lit(uint ch, uint len) {
 	return make0(LIT, ch, len);
 }
-Reg *Mark(uint id) {
+Reg Mark(uint id) {
 	return make0(MARK, id, 0);
 }
-Reg *Inf(Reg *head) {
-	if(head->type == EMPTY) return Empty();
-	if(head->type == ALL) return All();
-	if(head->type == NONE) return Empty();
-	if(head->type == INF) return head;
-	if(head->type == LIT && head->ch == 0 && head->len == 256) return All();
+Reg Inf(Reg head) {
+	if(tags[head].type == EMPTY) return Empty();
+	if(tags[head].type == ALL) return All();
+	if(tags[head].type == NONE) return Empty();
+	if(tags[head].type == INF) return head;
+	if(tags[head].type == LIT && links[head].ch == 0 && links[head].len == 256) return All();
 	return make1(INF, head);
 }
-Reg *Not(Reg *head) {
-	if(head->type == ALL) return None();
-	if(head->type == NONE) return All();
+Reg Not(Reg head) {
+	if(tags[head].type == ALL) return None();
+	if(tags[head].type == NONE) return All();
 	return make1(NOT, head);
 }
-Reg *Seq(Reg *head, Reg *tail) {
-	if(head->type == EMPTY) return tail;
-	if(tail->type == EMPTY) return head;
-	if(head->type == NONE) return None();
-	if(tail->type == NONE) return None();
+Reg Seq(Reg head, Reg tail) {
+	if(tags[head].type == EMPTY) return tail;
+	if(tags[tail].type == EMPTY) return head;
+	if(tags[head].type == NONE) return None();
+	if(tags[tail].type == NONE) return None();
 	return append(SEQ, head, tail);
 }
-Reg *Or(Reg *head, Reg *tail) {
-	if(head->type == ALL) return All();
-	if(tail->type == ALL) return All();
-	if(head->type == NONE) return tail;
-	if(tail->type == NONE) return head;
+Reg Or(Reg head, Reg tail) {
+	if(tags[head].type == ALL) return All();
+	if(tags[tail].type == ALL) return All();
+	if(tags[head].type == NONE) return tail;
+	if(tags[tail].type == NONE) return head;
 	return merge(OR, head, tail);
 }
-Reg *And(Reg *head, Reg *tail) {
-	if(head->type == ALL) return tail;
-	if(tail->type == ALL) return head;
-	if(head->type == NONE) return None();
-	if(tail->type == NONE) return None();
+Reg And(Reg head, Reg tail) {
+	if(tags[head].type == ALL) return tail;
+	if(tags[tail].type == ALL) return head;
+	if(tags[head].type == NONE) return None();
+	if(tags[tail].type == NONE) return None();
 	return merge(AND, head, tail);
 }
+// the regex matching every string of r written backwards, so the end of a match found
+// going forwards can be walked back to its start. NOT and AND reverse as they are,
+// since reversing a string commutes with complement and intersection
+Reg reversed[CACHE_SIZE]; // reversed[r] is Reverse(r), NIL until asked for
+Reg Reverse(Reg r) {
+	Reg d = __atomic_load_n(&reversed[r], __ATOMIC_ACQUIRE);
+	if(d != NIL)
+		return d;
+	d = r;
+	switch(tags[r].type) {
+		case UNUSED:
+			die("reversing UNUSED node");
+		case EMPTY:
+		case ALL:
+		case NONE:
+		case LIT:
+		case MARK:
+		break;
+		case INF:
+			d = Inf(Reverse(links[r].head));
+		break;
+		case NOT:
+			d = Not(Reverse(links[r].head));
+		break;
+		case SEQ:
+			d = Seq(Reverse(links[r].tail), Reverse(links[r].head));
+		break;
+		case OR:
+		case AND: {
+			Reg ds[links[r].n];
+			for(int i = 0; i < links[r].n; i++)
+				ds[i] = Reverse(children(r)[i]);
+			d = join(tags[r].type, ds, links[r].n);
+		} break;
+	}
+	// like derivs[], a racing thread can only have stored the same node
+	__atomic_store_n(&reversed[r], d, __ATOMIC_RELEASE);
+	return d;
+}
 #endif
 #if 1 // parse
-char *reg = NULL;
+__thread char *reg = NULL; // each thread parses with its own cursor
 bool more() { return *reg != '\0'; }
 char peek() { return *reg; }
 void eat(char c) { if(c == *reg) reg++; else die("expected %c got %c", c, *reg); }
@@ -218,9 +595,14 @@ bool ate(char c) {
 	}
 	return false;
 }
+// next() steps over the end of the regex like any other byte, so the end is checked first
 char parse_esc() {
+	if(!more())
+		die("unexpected end of regex");
 	if(peek() != '\\') return next();
 	eat('\\');
+	if(!more())
+		die("unexpected end of regex");
 	char c = next();
 	switch(c) {
 		case 'r': c = '\r'; break;
@@ -230,10 +612,10 @@ char parse_esc() {
 	}
 	return c;
 }
-Reg *parse_class() {
+Reg parse_class() {
 	eat('[');
 	bool inv = ate('^');
-	Reg *r = None();
+	Reg r = None();
 	for(;;) {
 		if(!more())
 			die("unexpected end of class");
@@ -254,31 +636,52 @@ Reg *parse_class() {
 		}
 	}
 }
-int marks = 0;
-char *names[CACHE_SIZE];
-Reg *parse_mark() {
+// the names of marks, a mark's id is where its name is in here. ids only have to tell
+// apart the marks of patterns labelled together, so every program, rule set and library
+// handle numbers its own from 0, and a mark node is shared by every pattern with its id
+struct names {
+	char **name;
+	int n, cap;
+};
+typedef struct names Names;
+Names names; // the marks of the patterns a program parses itself, the only ones print() knows
+__thread Names *naming; // where the running parse() numbers its marks
+int name_mark(Names *m, char *name, size_t len) {
+	if(m->n == m->cap) {
+		m->cap = m->cap ? m->cap * 2 : 8;
+		m->name = realloc(m->name, sizeof(char *) * m->cap);
+		if(m->name == NULL)
+			die("out of memory for marks");
+	}
+	if((m->name[m->n] = strndup(name, len)) == NULL)
+		die("out of memory for marks");
+	return m->n++;
+}
+void names_free(Names *m) {
+	for(int i = 0; i < m->n; i++)
+		free(m->name[i]);
+	free(m->name);
+	*m = (Names){ 0 };
+}
+// every mark in a pattern is a new one, even if it has the same name as another
+Reg parse_mark() {
 	eat('`');
-	static char buf[CACHE_SIZE];
-	static int pos = 0;
-	int len = 0;
+	char *name = reg;
 	while(peek() != '`')
 		if(more())
-			buf[pos + len++] = next();
+			next();
 		else
 			die("unexpected end of mark");
+	int id = name_mark(naming, name, reg - name);
 	eat('`');
-	buf[pos + len] = '\0';
-	Reg *r = Mark(marks);
-	names[marks++] = &buf[pos];
-	pos = pos + len + 1;
-	return r;
+	return Mark(id);
 }
-Reg *parse_and();
-Reg *parse_atom() {
+Reg parse_and();
+Reg parse_atom() {
 	switch(peek()) {
 		case '(':
 			eat('(');
-			Reg *r = parse_and();
+			Reg r = parse_and();
 			eat(')');
 			return r;
 		case '[':
@@ -290,12 +693,14 @@ Reg *parse_atom() {
 			return Lit(0, 256);
 		case '\\':
 			return Lit(parse_esc(), 1);
+		case '\0':
+			die("unexpected end of regex");
 		default:
 			return Lit(next(), 1);
 	}
 }
-Reg *parse_post() {
-	Reg *r = parse_atom();
+Reg parse_post() {
+	Reg r = parse_atom();
 	while(more() && (peek() == '*' || peek() == '+' || peek() == '!' || peek() == '?')) {
 		if(ate('*')) r = Inf(r);
 		else if(ate('+')) r = Seq(r, Inf(r));
@@ -305,95 +710,171 @@ Reg *parse_post() {
 	}
 	return r;
 }
-Reg *parse_seq() {
-	Reg *r = parse_post();
+Reg parse_seq() {
+	Reg r = parse_post();
 	while(more() && peek() != ')' && peek() != '|' && peek() != '&')
 		r = Seq(r, parse_post());
 	return r;
 }
-Reg *parse_or() {
-	Reg *r = parse_seq();
-	while(ate('|'))
-		r = Or(r, parse_seq());
+// every operand is collected first, so a wide list is sorted and interned only once
+// the operands of every list being parsed share one stack per thread, innermost on top,
+// so a parse that dies part way through leaves nothing behind to free
+__thread Reg *operands = NULL;
+__thread int noperands = 0, operands_cap = 0;
+Reg parse_list(Type type, char op, Reg (*operand)()) {
+	int from = noperands;
+	do {
+		Reg r = operand();
+		if(noperands == operands_cap) {
+			operands_cap = operands_cap ? operands_cap * 2 : 64;
+			operands = realloc(operands, sizeof(Reg) * operands_cap);
+			if(operands == NULL)
+				die("out of memory for %c list", op);
+		}
+		operands[noperands++] = r;
+	} while(ate(op));
+	Reg r = join(type, &operands[from], noperands - from);
+	noperands = from;
 	return r;
 }
-Reg *parse_and() {
-	Reg *r = parse_or();
-	while(ate('&'))
-		r = And(r, parse_or());
-	return r;
+Reg parse_or() {
+	return parse_list(OR, '|', parse_seq);
+}
+Reg parse_and() {
+	return parse_list(AND, '&', parse_or);
 }
-Reg *parse(char *s) {
+Reg parse(Names *into, char *s) {
+	TRACE_BEGIN("parse");
+	naming = into;
 	reg = s;
-	return parse_and();
+	noperands = 0; // whatever a parse that died left there
+	Reg r = parse_and();
+	TRACE_END("parse");
+	return r;
+}
+#endif
+#if 1 // emit
+// every emitter writes through one big buffer, with integers formatted by hand,
+// so printing a big automaton costs about what writing it out does
+char emitted[1 << 16];
+size_t nemitted = 0;
+void echo_flush() {
+	fwrite(emitted, 1, nemitted, stdout);
+	nemitted = 0;
+}
+void echo(char *s, size_t n) {
+	if(nemitted + n > sizeof(emitted)) {
+		echo_flush();
+		if(n > sizeof(emitted)) {
+			fwrite(s, 1, n, stdout);
+			return;
+		}
+	}
+	memcpy(&emitted[nemitted], s, n);
+	nemitted += n;
+}
+void echo_s(char *s) {
+	echo(s, strlen(s));
+}
+void echo_c(char c) {
+	if(nemitted == sizeof(emitted))
+		echo_flush();
+	emitted[nemitted++] = c;
+}
+void echo_i(long i) {
+	char buf[24], *p = &buf[24];
+	unsigned long u = i < 0 ? -(unsigned long)i : i;
+	do
+		*--p = '0' + u % 10;
+	while((u /= 10) > 0);
+	if(i < 0)
+		*--p = '-';
+	echo(p, &buf[24] - p);
 }
 #endif
 #if 1 // dfa
-void print(Reg *r) {
-	switch(r->type) {
-		case UNUSED: printf("Unused()"); break;
-		case EMPTY: printf("Empty()"); break;
-		case ALL: printf("All()"); break;
-		case NONE: printf("None()"); break;
-		case LIT: printf("Lit(%i, %i)", r->ch, r->len); break;
-		case MARK: printf("Mark(%s)", names[r->ch]); break;
-		case INF: printf("Inf("); print(r->head); printf(")"); break;
-		case NOT: printf("Not("); print(r->head); printf(")"); break;
-		case SEQ: printf("Seq("); print(r->head); printf(", "); print(r->tail); printf(")"); break;
-		case OR: printf("Or("); print(r->head); printf(", "); print(r->tail); printf(")"); break;
-		case AND: printf("And("); print(r->head); printf(", "); print(r->tail); printf(")"); break;
-	}
-}
-Reg *derive(int ch, Reg *r) {
-	if(r->next[ch] == NULL) {
+void print(Reg r) {
+	switch(tags[r].type) {
+		case UNUSED: echo_s("Unused()"); break;
+		case EMPTY: echo_s("Empty()"); break;
+		case ALL: echo_s("All()"); break;
+		case NONE: echo_s("None()"); break;
+		case LIT: echo_s("Lit("); echo_i(links[r].ch); echo_s(", "); echo_i(links[r].len); echo_s(")"); break;
+		case MARK:
+			echo_s("Mark(");
+			if(links[r].ch < names.n)
+				echo_s(names.name[links[r].ch]);
+			else
+				echo_i(links[r].ch);
+			echo_s(")");
+		break;
+		case INF: echo_s("Inf("); print(links[r].head); echo_s(")"); break;
+		case NOT: echo_s("Not("); print(links[r].head); echo_s(")"); break;
+		case SEQ: echo_s("Seq("); print(links[r].head); echo_s(", "); print(links[r].tail); echo_s(")"); break;
+		case OR:
+		case AND:
+			echo_s(tags[r].type == OR ? "Or(" : "And(");
+			for(int i = 0; i < links[r].n; i++) {
+				echo_s(i > 0 ? ", " : "");
+				print(children(r)[i]);
+			}
+			echo_s(")");
+		break;
+	}
+}
+Reg derive(int ch, Reg r) {
+	// leaves have nothing worth caching
+	switch(tags[r].type) {
+		case UNUSED:
+			die("deriving UNUSED node");
+		case EMPTY:
+		case NONE:
+		case MARK:
+			return None();
+		case ALL:
+			return All();
+		case LIT:
+			return ch >= links[r].ch && ch < links[r].ch + links[r].len ? Empty() : None();
+		default:
+		break;
+	}
+	// other threads may be deriving the same node, so derivs[] is read and published atomically
+	Reg *slot = &derivs[cached[r] + class_of(r, ch)];
+	Reg d = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	STAT(d == NIL ? stats.misses++ : stats.hits++);
+	if(d == NIL) {
 		//printf("DERIVE %i ", ch);
 		//print(r);
 		//printf("\n");
-		switch(r->type) {
-			case UNUSED:
-				die("deriving UNUSED node");
-			break;
-			case EMPTY:
-				r->next[ch] = None();
-			break;
-			case ALL:
-				r->next[ch] = All();
-			break;
-			case NONE:
-				r->next[ch] = None();
-			break;
-			case LIT:
-				if(ch >= r->ch && ch < r->ch + r->len)
-					r->next[ch] = Empty();
-				else
-					r->next[ch] = None();
-			break;
-			case MARK:
-				r->next[ch] = None();
-			break;
+		switch(tags[r].type) {
 			case INF:
-				r->next[ch] = Seq(derive(ch, r->head), r);
+				d = Seq(derive(ch, links[r].head), r);
 			break;
 			case NOT:
-				r->next[ch] = Not(derive(ch, r->head));
+				d = Not(derive(ch, links[r].head));
 			break;
 			case SEQ:
-				r->next[ch] = Seq(derive(ch, r->head), r->tail);
-				if(r->head->null)
-					r->next[ch] = Or(r->next[ch], derive(ch, r->tail));
+				d = Seq(derive(ch, links[r].head), links[r].tail);
+				if(tags[links[r].head].null)
+					d = Or(d, derive(ch, links[r].tail));
 			break;
 			case OR:
-				r->next[ch] = Or(derive(ch, r->head), derive(ch, r->tail));
-			break;
-			case AND:
-				r->next[ch] = And(derive(ch, r->head), derive(ch, r->tail));
-			break;
+			case AND: {
+				Reg ds[links[r].n];
+				for(int i = 0; i < links[r].n; i++)
+					ds[i] = derive(ch, children(r)[i]);
+				d = join(tags[r].type, ds, links[r].n);
+			} break;
+			default:
+				die("deriving leaf node");
 		}
+		// a racing thread can only have published the same node, since it's hash-consed
+		__atomic_store_n(slot, d, __ATOMIC_RELEASE);
 	}
-	return r->next[ch];
+	return d;
 }
-bool marked(Reg *r, uint mark) {
-	switch(r->type) {
+bool marked(Reg r, uint mark) {
+	switch(tags[r].type) {
 		case UNUSED:
 			die("mark testing UNUSED node");
 		case EMPTY:
@@ -405,22 +886,28 @@ bool marked(Reg *r, uint mark) {
 		case LIT:
 			return false;
 		case MARK:
-			return r->ch == mark;
+			return links[r].ch == mark;
 		case INF:
-			return marked(r->head, mark);
+			return marked(links[r].head, mark);
 		case NOT:
-			return !marked(r->head, mark);
+			return !marked(links[r].head, mark);
 		case SEQ:
-			return marked(r->head, mark) || (r->head->null && marked(r->tail, mark));
+			return marked(links[r].head, mark) || (tags[links[r].head].null && marked(links[r].tail, mark));
 		case OR:
-			return marked(r->head, mark) || marked(r->tail, mark);
+			for(int i = 0; i < links[r].n; i++)
+				if(marked(children(r)[i], mark))
+					return true;
+			return false;
 		case AND:
-			return marked(r->head, mark) && marked(r->tail, mark);
+			for(int i = 0; i < links[r].n; i++)
+				if(!marked(children(r)[i], mark))
+					return false;
+			return true;
 	}
 }
 #if 0
-void marks(Reg *r) {
-	switch(r->type) {
+void marks(Reg r) {
+	switch(tags[r].type) {
 		case UNUSED:
 			die("mark testing UNUSED node");
 		break;
@@ -434,109 +921,2418 @@ void marks(Reg *r) {
 		case LIT:
 		break;
 		case MARK: // print the mark, since we found one
-			printf("mark %s\n", &names[r->ch]);
+			printf("mark %s\n", names.name[links[r].ch]);
 		break;
 		case INF: // whatever's on the inside will be at the front in every iteration
-			marks(r->head);
+			marks(links[r].head);
 		break;
 		case NOT:
 		break;
 		case SEQ: // same as with the SEQ case for derive, do the head, and if the head is null, do the tail also
-			marks(r->head);
-			if(r->head->null)
-				marks(r->tail);
+			marks(links[r].head);
+			if(tags[links[r].head].null)
+				marks(links[r].tail);
 		break;
 		case OR: // either side could be at the front
-			marks(r->head);
-			marks(r->tail);
+			marks(links[r].head);
+			marks(links[r].tail);
 		break;
 		case AND:
 		break;
 	}
 }
 #endif
+// fill in the edges of a state, deriving once per class and merging
+// neighbouring classes that lead to the same place
+void transitions(Reg r) {
+	if(__atomic_load_n(&edges[r], __ATOMIC_ACQUIRE) != NULL)
+		return;
+	struct edge *e = malloc(sizeof(struct edge) * classes(r));
+	if(e == NULL)
+		die("out of memory for edges");
+	int n = 0;
+	for(int lo = 0, hi; lo < 256; lo = hi + 1) {
+		hi = next_bound(r, lo + 1) - 1;
+		Reg d = derive(lo, r);
+		if(n > 0 && e[n - 1].to == d)
+			e[n - 1].hi = hi;
+		else
+			e[n++] = (struct edge){ lo, hi, d };
+	}
+	// a state can be labelled in more than one context at once, and whichever finishes
+	// second throws its edges away, they're the same
+	nedges[r] = n;
+	struct edge *none = NULL;
+	if(__atomic_compare_exchange_n(&edges[r], &none, e, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		STAT(stats.bytes += sizeof(struct edge) * classes(r));
+	else
+		free(e);
+}
+// limits on what a single label() may build, 0 means no limit. a label() that runs
+// out is undone, and the caller falls back to a lazy table, see table_lazy()
+// every context takes a copy of this one when it's made, the library sets its own
+struct budget {
+	long states, nodes;
+	double seconds;
+} budget;
+char *fallback = NULL; // the limit the last label() that fell back ran out of, in any context
+// the states labelled so far and what analyse() found out about them. nodes and their
+// derivatives are shared, but every context numbers its own states, so compiles in
+// different contexts can run at once on different threads. a context is only ever
+// used by one compile at a time
+struct context {
+	Names *names; // the marks of the patterns labelled in it, NULL if they have none
+	struct budget budget; // for each label() in it
+	int *ids; // ids[r] is the id of state r, 0 if it isn't labelled
+	Reg *states; // states[id - 1] is the labelled state with that id
+	int nstates; // counter persists across calls, until context_reset()
+	char *over; // the limit the running label() ran out of, NULL while it hasn't
+	int budget_from; // nstates when the running label() started
+	long made; // nodes the running label() has made so far, on every thread it runs on
+	double budget_end; // and when it has to be done by
+	long explored; // states explored by label_parallel() so far
+	struct deque *deques; // one per label_parallel() worker
+	long pending; // states discovered but not explored yet, the workers stop when it hits 0
+	struct stats *totals; // where the workers add their counters when they finish
+	Lock totals_lock;
+	int *front; // marks at the front of state id - 1 are front[fronts[i]] to front[fronts[i + 1] - 1]
+	uint32_t *fronts, front_cap;
+	uint8_t *fates; // fates[id - 1], see analyse()
+	int sink; // state id - 1 that every dead state collapses into, -1 if there are none
+	int analysed; // states analyse() has been through, none of them change again
+};
+typedef struct context Context;
+// the arrays are as long as the node cache, but calloc() maps them in on demand, so
+// a context only costs the pages its states touch
+Context *context_new(Names *names) {
+	Context *c = calloc(1, sizeof(Context));
+	if(c == NULL)
+		die("out of memory for context");
+	c->names = names;
+	c->budget = budget;
+	c->ids = calloc(CACHE_SIZE, sizeof(int));
+	c->states = calloc(CACHE_SIZE, sizeof(Reg));
+	c->fronts = calloc(CACHE_SIZE + 1, sizeof(uint32_t));
+	c->fates = calloc(CACHE_SIZE, sizeof(uint8_t));
+	if(c->ids == NULL || c->states == NULL || c->fronts == NULL || c->fates == NULL)
+		die("out of memory for context");
+	c->sink = -1;
+	return c;
+}
+// forget every state, so the next table only has the states labelled after this
+void context_reset(Context *c) {
+	for(int i = 0; i < c->nstates; i++)
+		c->ids[c->states[i]] = 0;
+	c->nstates = 0;
+	c->analysed = 0;
+	c->sink = -1;
+}
+void context_free(Context *c) {
+	free(c->ids);
+	free(c->states);
+	free(c->fronts);
+	free(c->fates);
+	free(c->front);
+	free(c);
+}
+double clock_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+// the node arrays and pools don't grow, so a label() that would fill one falls back no
+// matter its budget, leaving what's left for a lazy table to derive into
+bool crowded() {
+	long nodes = __atomic_load_n(&survived, __ATOMIC_RELAXED) + __atomic_load_n(&handed, __ATOMIC_RELAXED);
+	return nodes > CACHE_SIZE / 4 * 3 || __atomic_load_n(&pooled, __ATOMIC_RELAXED) > POOL_SIZE / 4 * 3
+		|| __atomic_load_n(&nderivs, __ATOMIC_RELAXED) > POOL_SIZE / 4 * 3;
+}
+// can another state be labelled after the first n, the clock is only read every 64
+// nodes are counted across every context, since they're shared
+// the nodes c's running label() has made, counting the ones this thread made since it
+// last counted. a label() only counts its own, not those of compiles on other threads
+__thread long counted = 0;
+long made_by(Context *c) {
+	long mine = made - counted;
+	counted = made;
+	return __atomic_add_fetch(&c->made, mine, __ATOMIC_RELAXED);
+}
+bool over_budget(Context *c, long n) {
+	if(__atomic_load_n(&c->over, __ATOMIC_RELAXED) != NULL)
+		return true;
+	char *why = NULL;
+	if(c->budget.states > 0 && n >= c->budget.states)
+		why = "states";
+	else if(c->budget.nodes > 0 && made_by(c) > c->budget.nodes)
+		why = "nodes";
+	else if(c->budget.seconds > 0 && n % 64 == 0 && clock_seconds() > c->budget_end)
+		why = "time";
+	else if(crowded())
+		why = "space";
+	if(why != NULL)
+		__atomic_store_n(&c->over, why, __ATOMIC_RELAXED);
+	return why != NULL;
+}
 // assign a unique nonzero id to every state in the regex, in depth first order
-void label(Reg *r) {
-	static int id = 1; // static counter persists accross calls
-	if(r->id > 0) // already did this node, don't loop forever
+// the depth first search keeps its own stack of states and the edge each is up to,
+// since a path through the DFA can be as long as it has states, far deeper than the
+// C stack goes. states are numbered in the same order a recursive search would
+struct visit {
+	Reg r;
+	int edge; // the next edge of r to follow
+};
+void label_state(Context *c, Reg r) {
+	if(c->ids[r] > 0) // already did this node, don't loop forever, -1 means explored by label_parallel()
 		return;
-	r->id = id++; // assign an id
-	// label the regex we get from deriving by each character
-	// this is effectively doing a graph traversal of the final DFA
-	for(int ch = 0; ch < 256; ch++)
-		label(derive(ch, r));
+	long n = 0, cap = 1024;
+	struct visit *stack = malloc(sizeof(struct visit) * cap);
+	if(stack == NULL)
+		die("out of memory for labelling");
+	for(;;) {
+		if(over_budget(c, c->nstates - c->budget_from)) // label() undoes whatever was done
+			break;
+		c->ids[r] = ++c->nstates; // assign an id
+		STAT(stats.labelled++);
+		c->states[c->ids[r] - 1] = r;
+		// label the regex we get from deriving by each class of characters
+		// this is effectively doing a graph traversal of the final DFA
+		transitions(r);
+		if(n == cap) {
+			stack = realloc(stack, sizeof(struct visit) * (cap *= 2));
+			if(stack == NULL)
+				die("out of memory for labelling");
+		}
+		stack[n++] = (struct visit){ r, 0 };
+		// back up to the first state with an edge to an unlabelled one, which is next
+		r = NIL;
+		while(n > 0 && r == NIL) {
+			struct visit *v = &stack[n - 1];
+			if(v->edge == nedges[v->r])
+				n--;
+			else if(c->ids[edges[v->r][v->edge++].to] <= 0)
+				r = edges[v->r][v->edge - 1].to;
+		}
+		if(r == NIL)
+			break;
+	}
+	free(stack);
+}
+// parallel exploration for label(), every worker derives whole states off its own deque
+// and steals from the others when it runs dry. ids are still handed out afterwards by
+// label_state(), which only hits the derivative cache, so numbering is deterministic
+int jobs = 1; // worker threads used by label(), set with -j
+struct deque {
+	Lock lock;
+	Reg *items;
+	long top, bottom, cap; // owner pushes and pops at bottom, thieves take from top
+};
+struct worker {
+	Context *c;
+	int me; // which of c->deques is its own
+};
+void push(struct deque *q, Reg r) {
+	lock(&q->lock);
+	if(q->bottom == q->cap) {
+		// slide everything down to the start before growing
+		memmove(q->items, &q->items[q->top], sizeof(Reg) * (q->bottom - q->top));
+		q->bottom -= q->top;
+		q->top = 0;
+		if(q->bottom == q->cap) {
+			q->cap = q->cap ? q->cap * 2 : 1024;
+			q->items = realloc(q->items, sizeof(Reg) * q->cap);
+			if(q->items == NULL)
+				die("out of memory for work queue");
+		}
+	}
+	q->items[q->bottom++] = r;
+	unlock(&q->lock);
+}
+Reg pop(struct deque *q) {
+	Reg r = NIL;
+	lock(&q->lock);
+	if(q->bottom > q->top)
+		r = q->items[--q->bottom];
+	unlock(&q->lock);
+	return r;
 }
-// print out the DFA from the given regex
-void dfa(Reg *r) {
-	// each Reg is marked so that we cover every state exactly once
-	if(r->done)
+Reg steal(struct deque *q) {
+	Reg r = NIL;
+	lock(&q->lock);
+	if(q->bottom > q->top)
+		r = q->items[q->top++];
+	unlock(&q->lock);
+	return r;
+}
+// claim r for exploration, id goes from 0 (unseen) to -1 (seen, waiting for its number)
+bool discover(Context *c, Reg r) {
+	int unseen = 0;
+	return __atomic_compare_exchange_n(&c->ids[r], &unseen, -1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+void *explore(void *arg) {
+	Context *c = ((struct worker *)arg)->c;
+	int me = ((struct worker *)arg)->me;
+	TRACE_BEGIN("explore");
+	while(__atomic_load_n(&c->pending, __ATOMIC_ACQUIRE) > 0 && __atomic_load_n(&c->over, __ATOMIC_RELAXED) == NULL) {
+		Reg r = pop(&c->deques[me]);
+		for(int i = 1; r == NIL && i < jobs; i++)
+			r = steal(&c->deques[(me + i) % jobs]);
+		if(r == NIL) {
+			sched_yield();
+			continue;
+		}
+		if(over_budget(c, __atomic_fetch_add(&c->explored, 1, __ATOMIC_RELAXED)))
+			break;
+		transitions(r);
+		for(int i = 0; i < nedges[r]; i++) {
+			Reg d = edges[r][i].to;
+			if(discover(c, d)) {
+				__atomic_add_fetch(&c->pending, 1, __ATOMIC_RELEASE);
+				push(&c->deques[me], d);
+			}
+		}
+		__atomic_sub_fetch(&c->pending, 1, __ATOMIC_RELEASE);
+	}
+	TRACE_END("explore");
+	lock(&c->totals_lock);
+	stats_add(c->totals, &stats);
+	unlock(&c->totals_lock);
+	return NULL;
+}
+void label_parallel(Context *c, Reg r) {
+	if(!discover(c, r))
+		return;
+	c->deques = calloc(jobs, sizeof(struct deque));
+	pthread_t *workers = malloc(sizeof(pthread_t) * jobs);
+	struct worker *args = malloc(sizeof(struct worker) * jobs);
+	if(c->deques == NULL || workers == NULL || args == NULL)
+		die("out of memory for workers");
+	c->totals = &stats;
+	c->pending = 1;
+	push(&c->deques[0], r);
+	for(int i = 0; i < jobs; i++) {
+		args[i] = (struct worker){ c, i };
+		if(pthread_create(&workers[i], NULL, explore, &args[i]) != 0)
+			die("can't start worker %i", i);
+	}
+	for(int i = 0; i < jobs; i++)
+		pthread_join(workers[i], NULL);
+	for(int i = 0; i < jobs; i++)
+		free(c->deques[i].items);
+	free(c->deques);
+	free(workers);
+	free(args);
+}
+// the same marks as marked(), all at once, or'd into a bitset of words 64 bit words
+// NOT and AND can set bits past the last mark, the caller only looks at the marks it knows
+void front_marks(Reg r, uint64_t *set, int words) {
+	switch(tags[r].type) {
+		case MARK:
+			set[links[r].ch / 64] |= 1ULL << links[r].ch % 64;
+		break;
+		case INF:
+			front_marks(links[r].head, set, words);
+		break;
+		case SEQ:
+			front_marks(links[r].head, set, words);
+			if(tags[links[r].head].null)
+				front_marks(links[r].tail, set, words);
+		break;
+		case OR:
+			for(int i = 0; i < links[r].n; i++)
+				front_marks(children(r)[i], set, words);
+		break;
+		case NOT:
+		case AND: {
+			// every mark for NOT, minus the ones at its head, and only the ones every child has for AND
+			uint64_t all[words], sub[words];
+			memset(all, 0xff, sizeof(all));
+			for(int i = 0; i < (tags[r].type == NOT ? 1 : links[r].n); i++) {
+				memset(sub, 0, sizeof(sub));
+				front_marks(tags[r].type == NOT ? links[r].head : children(r)[i], sub, words);
+				for(int w = 0; w < words; w++)
+					all[w] &= tags[r].type == NOT ? ~sub[w] : sub[w];
+			}
+			for(int w = 0; w < words; w++)
+				set[w] |= all[w];
+		} break;
+		default:
+		break;
+	}
+}
+bool same_marks(Context *c, int a, int b) {
+	uint32_t *fronts = c->fronts;
+	return fronts[a + 1] - fronts[a] == fronts[b + 1] - fronts[b]
+		&& memcmp(&c->front[fronts[a]], &c->front[fronts[b]], sizeof(int) * (fronts[a + 1] - fronts[a])) == 0;
+}
+// what can still happen after reaching each labelled state, filled in by analyse()
+enum fate { LIVE = 0, DEAD, FULL };
+// where an edge to r really goes, dead states all go to the sink
+int row(Context *c, Reg r) {
+	return c->fates[c->ids[r] - 1] == DEAD ? c->sink : c->ids[r] - 1;
+}
+// a dead state can never reach an accepting state, and a full state accepts and only
+// reaches full states with the same marks, so either way the rest of the input can't
+// change the outcome and scanners can stop reading it
+// only the states labelled since last time are looked at, since a state labelled
+// before only leads to states that were too, and their fates are already settled
+void analyse(Context *c) {
+	int lo = c->analysed, n = c->nstates, *ids = c->ids;
+	if(lo >= n)
 		return;
-	r->done = true;
-	if(r->type == ALL) die("all in production");
-	if(r->type == NONE) {
-		printf("%i [label=\"default\"];\n", r->id - 1);
+	TRACE_BEGIN("analyse");
+	Reg *states = c->states;
+	uint8_t *fates = c->fates;
+	uint32_t *fronts = c->fronts;
+	int known = c->names ? c->names->n : 0, words = known / 64 + 1;
+	for(int i = lo; i < n; i++) {
+		uint64_t set[words];
+		memset(set, 0, sizeof(set));
+		front_marks(states[i], set, words);
+		fronts[i + 1] = fronts[i];
+		for(int m = 0; m < known; m++)
+			if(set[m / 64] >> m % 64 & 1) {
+				if(fronts[i + 1] == c->front_cap) {
+					c->front_cap = c->front_cap ? c->front_cap * 2 : 1024;
+					c->front = realloc(c->front, sizeof(int) * c->front_cap);
+					if(c->front == NULL)
+						die("out of memory for marks");
+				}
+				c->front[fronts[i + 1]++] = m;
+			}
+	}
+	// edges backwards between the new states, preds[into[k]] to preds[into[k + 1] - 1]
+	// lead to state lo + k
+	int *into = calloc(n - lo + 1, sizeof(int)), *queue = malloc(sizeof(int) * (n - lo));
+	if(into == NULL || queue == NULL)
+		die("out of memory for analysis");
+	for(int i = lo; i < n; i++)
+		for(int j = 0; j < nedges[states[i]]; j++)
+			if(ids[edges[states[i]][j].to] - 1 >= lo)
+				into[ids[edges[states[i]][j].to] - 1 - lo]++;
+	for(int k = 1; k <= n - lo; k++)
+		into[k] += into[k - 1];
+	int *preds = malloc(sizeof(int) * (into[n - lo] + 1));
+	if(preds == NULL)
+		die("out of memory for analysis");
+	for(int i = n - 1; i >= lo; i--)
+		for(int j = 0; j < nedges[states[i]]; j++)
+			if(ids[edges[states[i]][j].to] - 1 >= lo)
+				preds[--into[ids[edges[states[i]][j].to] - 1 - lo]] = i;
+	// live is whatever reaches an accepting state, found backwards from them and
+	// from anything with an edge to an old state that's already known to be live
+	int head = 0, tail = 0;
+	for(int i = lo; i < n; i++) {
+		fates[i] = tags[states[i]].null ? LIVE : DEAD;
+		for(int j = 0; fates[i] == DEAD && j < nedges[states[i]]; j++) {
+			int to = ids[edges[states[i]][j].to] - 1;
+			if(to < lo && fates[to] != DEAD)
+				fates[i] = LIVE;
+		}
+		if(fates[i] == LIVE)
+			queue[tail++] = i;
+	}
+	while(head < tail)
+		for(int i = queue[head++], j = into[i - lo]; j < into[i - lo + 1]; j++)
+			if(fates[preds[j]] == DEAD) {
+				fates[preds[j]] = LIVE;
+				queue[tail++] = preds[j];
+			}
+	// full starts as every accepting state, then anything with an edge out of the full
+	// states or to different marks is dropped, along with every full state leading to it
+	for(int i = lo; i < n; i++)
+		if(tags[states[i]].null)
+			fates[i] = FULL;
+	head = tail = 0;
+	for(int i = lo; i < n; i++)
+		for(int j = 0; fates[i] == FULL && j < nedges[states[i]]; j++) {
+			int to = ids[edges[states[i]][j].to] - 1;
+			if(!tags[states[to]].null || (to < lo && fates[to] != FULL) || !same_marks(c, i, to)) {
+				fates[i] = LIVE;
+				queue[tail++] = i;
+			}
+		}
+	while(head < tail)
+		for(int i = queue[head++], j = into[i - lo]; j < into[i - lo + 1]; j++)
+			if(fates[preds[j]] == FULL) {
+				fates[preds[j]] = LIVE;
+				queue[tail++] = preds[j];
+			}
+	// None is the natural sink, but anything dead will do if it was never reached
+	// once there is one it stays put, so rows already exported stay right
+	if(c->sink < 0)
+		c->sink = ids[None()] - 1;
+	for(int i = lo; c->sink < 0 && i < n; i++)
+		if(fates[i] == DEAD)
+			c->sink = i;
+	c->analysed = n;
+	free(into);
+	free(queue);
+	free(preds);
+	TRACE_END("analyse");
+}
+// undo a label() that ran out of budget, every state it touched is reachable from r
+// through states that are new, old states only lead to old states
+void unlabel(Context *c, Reg r, int from) {
+	int *ids = c->ids;
+	if(ids[r] == 0 || (ids[r] > 0 && ids[r] <= from))
 		return;
+	Reg *stack = malloc(sizeof(Reg) * CACHE_SIZE);
+	if(stack == NULL)
+		die("out of memory for unlabel");
+	int n = 0;
+	ids[r] = 0;
+	stack[n++] = r;
+	while(n > 0) {
+		Reg s = stack[--n];
+		struct edge *e = __atomic_load_n(&edges[s], __ATOMIC_ACQUIRE);
+		for(int i = 0; e != NULL && i < nedges[s]; i++) {
+			Reg d = e[i].to;
+			if(ids[d] < 0 || ids[d] > from) {
+				ids[d] = 0;
+				stack[n++] = d;
+			}
+		}
+	}
+	free(stack);
+}
+// returns false if it ran out of budget, in which case nothing was labelled
+bool label(Context *c, Reg r) {
+	TRACE_BEGIN("label");
+	int from = c->budget_from = c->nstates;
+	c->made = 0;
+	counted = made;
+	c->budget_end = clock_seconds() + c->budget.seconds;
+	c->explored = 0;
+	c->over = NULL;
+	if(jobs > 1)
+		label_parallel(c, r);
+	label_state(c, r);
+	if(c->over != NULL) {
+		unlabel(c, r, from);
+		c->nstates = from;
+		__atomic_store_n(&fallback, c->over, __ATOMIC_RELAXED);
+		STAT(stats.fallbacks++);
+	} else {
+		analyse(c);
+	}
+	TRACE_END("label");
+	return c->over == NULL;
+}
+// a byte as it appears in a class label, escaped for a dot string on top of that
+void echo_byte(int ch) {
+	static char hex[] = "0123456789abcdef";
+	if(ch == ']' || ch == '\\' || ch == '^' || ch == '-')
+		echo_s("\\\\");
+	if(ch == '"' || ch == '\\')
+		echo_c('\\');
+	if(ch >= ' ' && ch < 127) {
+		echo_c(ch);
+	} else {
+		echo_s("\\\\x");
+		echo_c(hex[ch / 16]);
+		echo_c(hex[ch % 16]);
+	}
+}
+// every edge from r to row to, merged into one label like [a-z0-9]
+void echo_class(Context *c, Reg r, int to) {
+	int n = 0;
+	for(int i = 0; i < nedges[r]; i++)
+		n += row(c, edges[r][i].to) == to;
+	if(n == 1)
+		for(int i = 0; i < nedges[r]; i++)
+			if(row(c, edges[r][i].to) == to && edges[r][i].lo == edges[r][i].hi) {
+				echo_byte(edges[r][i].lo);
+				return;
+			}
+	echo_c('[');
+	for(int i = 0; i < nedges[r]; i++) {
+		struct edge *e = &edges[r][i];
+		if(row(c, e->to) != to)
+			continue;
+		echo_byte(e->lo);
+		if(e->hi > e->lo + 1)
+			echo_c('-');
+		if(e->hi > e->lo)
+			echo_byte(e->hi);
+	}
+	echo_c(']');
+}
+// print out the DFA from the given regex, breadth first, and only as far as hops
+// edges from the start if hops isn't negative. states cut off there are dashed
+// every state has one unlabelled edge to wherever most of its bytes go, and one
+// labelled edge to each other state it leads to
+void dfa(Context *c, Reg r, int hops) {
+	TRACE_BEGIN("emit dot");
+	int nstates = c->nstates;
+	int *queue = malloc(sizeof(int) * nstates), *depth = malloc(sizeof(int) * nstates);
+	if(queue == NULL || depth == NULL)
+		die("out of memory for dot");
+	for(int i = 0; i < nstates; i++)
+		depth[i] = -1;
+	int head = 0, tail = 0, start = row(c, r);
+	queue[tail++] = start;
+	depth[start] = 0;
+	while(head < tail) {
+		int i = queue[head++];
+		Reg s = c->states[i];
+		echo_i(i);
+		// dead states all print as the sink
+		if(c->fates[i] == DEAD) {
+			echo_s(" [label=\"default\"];\n");
+			continue;
+		}
+		bool cut = depth[i] == hops;
+		echo_s(i == start ? " [shape=doublecircle," : " [");
+		echo_s(cut ? "style=dashed,label=\"" : "label=\"");
+		for(int j = c->fronts[i]; j < c->fronts[i + 1]; j++) {
+			echo_s(c->names->name[c->front[j]]);
+			echo_c(' ');
+		}
+		echo_s("\"];\n");
+		if(cut)
+			continue;
+		// the default is whichever state most bytes go to
+		int other = row(c, edges[s][0].to), most = 0;
+		for(int j = 0; j < nedges[s]; j++) {
+			int to = row(c, edges[s][j].to), bytes = 0;
+			for(int k = 0; k < nedges[s]; k++)
+				if(row(c, edges[s][k].to) == to)
+					bytes += edges[s][k].hi - edges[s][k].lo + 1;
+			if(bytes > most) {
+				most = bytes;
+				other = to;
+			}
+		}
+		for(int j = 0; j < nedges[s]; j++) {
+			int to = row(c, edges[s][j].to);
+			bool first = true; // each state only gets one edge, at its first range
+			for(int k = 0; k < j; k++)
+				first = first && row(c, edges[s][k].to) != to;
+			if(first && depth[to] < 0) {
+				depth[to] = depth[i] + 1;
+				queue[tail++] = to;
+			}
+			if(!first || to == other)
+				continue;
+			echo_i(i);
+			echo_s(" -> ");
+			echo_i(to);
+			echo_s(" [label=\"");
+			echo_class(c, s, to);
+			echo_s("\"];\n");
+		}
+		echo_i(i);
+		echo_s(" -> ");
+		echo_i(other);
+		echo_s(";\n");
 	}
-	// print off the ID, this will always be in order starting with 1
-	printf("%i [%slabel=\"", r->id - 1, r->id == 1 ? "shape=doublecircle," : "");
-	//printf("%i [label=\"", r->id - 1);
-	//print(r);
-	//printf("\", xlabel=\"");
-	/*printf("expr ");
+	free(queue);
+	free(depth);
+	TRACE_END("emit dot");
+}
+void pr(Reg r) {
+	echo_s("reg ");
+	echo_i(r);
+	echo_c(' ');
 	print(r);
-	printf("\n");*/
-	for(uint i = 0; i < marks; i++)
-		if(marked(r, i))
-			printf("%s ", names[i]);
-	//print(r);
-	printf("\"];\n");
-	// print off the transition table, for some basic compaction of the output, we print all transitions that are different from the transition on '\0', and default to that
-	for(int ch = 0; ch < 256; ch++)
-		if(r->next[ch] != r->next[0])
-			printf("%i -> %i [label=\"%i\"];\n", r->id - 1, r->next[ch]->id - 1, ch);
-	//printf("default %i\n\n", r->next[0]->id - 1);
-	printf("%i -> %i;\n", r->id - 1, r->next[0]->id - 1);
-	// walk the DFA in the same order as in label()
+	echo_c('\n');
+	echo_flush();
+}
+#endif
+#if 1 // equivalence
+// hopcroft and karp's equivalence check, run lazily over pairs of derivatives: two
+// regexes are equivalent if walking them in step never reaches a pair where one is
+// null and the other isn't. pairs already known to be equivalent are joined in a
+// union-find, so each one is walked once, and nothing is labelled along the way
+Reg uf[CACHE_SIZE]; // parent in the union-find, NIL for a root
+Reg find_root(Reg r) {
+	while(uf[r] != NIL && uf[uf[r]] != NIL)
+		r = uf[r] = uf[uf[r]]; // halve the path on the way up
+	return uf[r] != NIL ? uf[r] : r;
+}
+// a pair waiting to be checked, and how it was reached, so a counterexample can be
+// spelled out by following from back to the start
+struct pair {
+	Reg a, b;
+	int from;
+	uint8_t ch;
+};
+// returns the length of the shortest string only one of a and b matches, written
+// into witness, or -1 if they match the same strings. *pairs is how many were checked
+int equiv(Reg a, Reg b, char **witness, long *pairs) {
+	TRACE_BEGIN("equiv");
+	size_t cap = 1024, head = 0, tail = 0;
+	struct pair *queue = malloc(sizeof(struct pair) * cap);
+	Reg *touched = malloc(sizeof(Reg) * cap); // every node given a parent, to undo afterwards
+	size_t ntouched = 0;
+	if(queue == NULL || touched == NULL)
+		die("out of memory for equivalence");
+	queue[tail++] = (struct pair){ a, b, -1, 0 };
+	int found = -1;
+	while(head < tail) {
+		struct pair p = queue[head++];
+		Reg x = find_root(p.a), y = find_root(p.b);
+		if(x == y)
+			continue;
+		if(tags[p.a].null != tags[p.b].null) {
+			found = head - 1;
+			break;
+		}
+		uf[x] = y;
+		touched[ntouched++] = x;
+		// one pair per class of both, since either side is the same across one
+		for(int lo = 0, hi; lo < 256; lo = hi + 1) {
+			int na = next_bound(p.a, lo + 1), nb = next_bound(p.b, lo + 1);
+			hi = (na < nb ? na : nb) - 1;
+			if(tail == cap) {
+				cap *= 2;
+				queue = realloc(queue, sizeof(struct pair) * cap);
+				touched = realloc(touched, sizeof(Reg) * cap);
+				if(queue == NULL || touched == NULL)
+					die("out of memory for equivalence");
+			}
+			queue[tail++] = (struct pair){ derive(lo, p.a), derive(lo, p.b), head - 1, lo };
+		}
+	}
+	*pairs = head;
+	int len = 0;
+	if(found >= 0) {
+		for(int i = found; queue[i].from >= 0; i = queue[i].from)
+			len++;
+		*witness = malloc(len + 1);
+		(*witness)[len] = '\0';
+		for(int i = found, j = len; queue[i].from >= 0; i = queue[i].from)
+			(*witness)[--j] = queue[i].ch;
+	}
+	while(ntouched > 0)
+		uf[touched[--ntouched]] = NIL;
+	free(queue);
+	free(touched);
+	TRACE_END("equiv");
+	return found >= 0 ? len : -1;
+}
+// does b match everything a does? it does exactly when a|b is equivalent to b, and
+// then any witness is matched by a and not by b
+int subset(Reg a, Reg b, char **witness, long *pairs) {
+	return equiv(Or(a, b), b, witness, pairs);
+}
+#endif
+#if 1 // collection
+// mark and sweep over the node arrays, for processes that compile pattern after pattern
+// a node is kept if it's reachable from the roots through its children. whatever
+// derive(), Reverse() and transitions() cached that leads to a node that isn't is
+// forgotten, and worked out again if it's asked for. the ids of dead nodes are handed
+// out again by alloc(), and the two pools are slid down over the gaps they leave
+// nothing else may touch the nodes while it runs. every context still in use must have
+// its states in the roots, and any other must be reset before it's used again, the
+// same goes for the rows of a lazy table. packed tables and glushkov matchers hold no nodes
+// mark ids aren't global, their names go with whatever parsed them, see Names
+// worth collecting once the nodes made since last time outnumber the ones kept then
+#define COLLECT_AFTER (1 << 16)
+bool collect_due() {
+	long made = __atomic_load_n(&handed, __ATOMIC_RELAXED);
+	return made >= COLLECT_AFTER && made >= __atomic_load_n(&survived, __ATOMIC_RELAXED);
+}
+// a run of a pool owned by node r
+struct span {
+	uint32_t at, n;
+	Reg r;
+};
+int by_at(const void *a, const void *b) {
+	return ((struct span *)a)->at < ((struct span *)b)->at ? -1 : ((struct span *)a)->at > ((struct span *)b)->at;
+}
+// the rest of a pool after the spans that were kept, zeroed since derivs[] needs NIL there,
+// whole pages are handed back to the kernel, which zeroes them when they're touched again
+void release(Reg *from, Reg *to) {
+	uintptr_t page = sysconf(_SC_PAGESIZE), lo = ((uintptr_t)from + page - 1) / page * page;
+	if(lo >= (uintptr_t)to) {
+		memset(from, 0, (char *)to - (char *)from);
+		return;
+	}
+	memset(from, 0, lo - (uintptr_t)from);
+	madvise((void *)lo, (uintptr_t)to - lo, MADV_DONTNEED);
+}
+// slide spans down to the start of a pool in order, returns the new top
+uint32_t slide(Reg *pool, struct span *spans, long n, uint32_t top) {
+	qsort(spans, n, sizeof(struct span), by_at);
+	uint32_t to = 0;
+	for(long i = 0; i < n; i++) {
+		memmove(&pool[to], &pool[spans[i].at], sizeof(Reg) * spans[i].n);
+		spans[i].at = to;
+		to += spans[i].n;
+	}
+	release(&pool[to], &pool[top]);
+	return to;
+}
+#define LIVE(r) (live[(r) / 64] >> (r) % 64 & 1)
+void collect(Reg *roots, long nroots) {
+	TRACE_BEGIN("collect");
+	// a make that ran out of room left its counter past the end
+	used = used < CACHE_SIZE ? used : CACHE_SIZE;
+	pooled = pooled < POOL_SIZE ? pooled : POOL_SIZE;
+	nderivs = nderivs < POOL_SIZE ? nderivs : POOL_SIZE;
+	uint64_t *live = calloc(CACHE_SIZE / 64, sizeof(uint64_t));
+	Reg *stack = malloc(sizeof(Reg) * CACHE_SIZE);
+	struct span *spans = malloc(sizeof(struct span) * CACHE_SIZE);
+	if(live == NULL || stack == NULL || spans == NULL)
+		die("out of memory for collecting");
+	// the leaves are kept in statics, so they're always roots
+	Reg leaves[] = { Empty(), All(), None() };
+	long n = 0;
+	for(long i = 0; i < nroots + 3; i++) {
+		Reg r = i < nroots ? roots[i] : leaves[i - nroots];
+		if(r != NIL && !LIVE(r)) {
+			live[r / 64] |= 1ULL << r % 64;
+			stack[n++] = r;
+		}
+	}
+	while(n > 0) {
+		Reg r = stack[--n], *kids = &links[r].head;
+		int k = 0;
+		switch(tags[r].type) {
+			case INF:
+			case NOT: k = 1; break;
+			case SEQ: k = 2; break;
+			case OR:
+			case AND: kids = children(r); k = links[r].n; break;
+			default: break;
+		}
+		for(int i = 0; i < k; i++)
+			if(!LIVE(kids[i])) {
+				live[kids[i] / 64] |= 1ULL << kids[i] % 64;
+				stack[n++] = kids[i];
+			}
+	}
+	// sweep, a dead node is left as zeroed as a node that was never handed out
+	long kept = 0, dead = 0;
+	nfreed = 0;
+	for(Reg r = 1; r < used; r++) {
+		if(!LIVE(r)) {
+			dead += tags[r].type != UNUSED; // UNUSED ones were freed last time, and not handed out since
+			free(edges[r]);
+			edges[r] = NULL;
+			nedges[r] = 0;
+			tags[r] = (struct tag){ 0 };
+			memset(bounds[r], 0, sizeof(bounds[r]));
+			reversed[r] = NIL;
+			freed[nfreed++] = r;
+			continue;
+		}
+		kept++;
+		if(!LIVE(reversed[r]))
+			reversed[r] = NIL;
+		for(int i = 0; i < nedges[r]; i++)
+			if(!LIVE(edges[r][i].to)) {
+				free(edges[r]);
+				edges[r] = NULL;
+				nedges[r] = 0; // which ends the loop
+			}
+	}
+	// dead ids at the top are given back rather than kept for reuse
+	while(nfreed > 0 && freed[nfreed - 1] == used - 1) {
+		nfreed--;
+		used--;
+	}
+	// the children of live lists, which are all live themselves
+	n = 0;
+	for(Reg r = 1; r < used; r++)
+		if(LIVE(r) && (tags[r].type == OR || tags[r].type == AND))
+			spans[n++] = (struct span){ links[r].kids, links[r].n, r };
+	pooled = slide(pool, spans, n, pooled);
+	for(long i = 0; i < n; i++)
+		links[spans[i].r].kids = spans[i].at;
+	// the derivatives of live nodes, only the ones that are still live are kept
+	n = 0;
+	for(Reg r = 1; r < used; r++)
+		if(LIVE(r) && tags[r].type >= INF)
+			spans[n++] = (struct span){ cached[r], classes(r), r };
+	nderivs = slide(derivs, spans, n, nderivs);
+	for(long i = 0; i < n; i++) {
+		cached[spans[i].r] = spans[i].at;
+		for(uint32_t j = spans[i].at; j < spans[i].at + spans[i].n; j++)
+			if(!LIVE(derivs[j]))
+				derivs[j] = NIL;
+	}
+	// the hash-consing table only has live nodes in it afterwards
+	memset(slots, 0, sizeof(slots));
+	for(Reg r = 1; r < used; r++) {
+		if(!LIVE(r))
+			continue;
+		Reg *stripe = &slots[hashes[r] % STRIPES * STRIPE_SIZE];
+		uint i = 0;
+		while(stripe[(hashes[r] / STRIPES + i) % STRIPE_SIZE] != NIL)
+			i++;
+		stripe[(hashes[r] / STRIPES + i) % STRIPE_SIZE] = r;
+	}
+	// collect_due() reads these without stopping anything
+	__atomic_store_n(&handed, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&survived, kept, __ATOMIC_RELAXED);
+	STAT(stats.collected += dead);
+	free(live);
+	free(stack);
+	free(spans);
+	TRACE_END("collect");
+}
+#undef LIVE
+#endif
+#if 1 // scan
+// a labelled DFA flattened into a dense transition table, row i is state id i + 1
+// until table_pack() renumbers it
+struct table {
+	int states;
+	int *next; // next[(state << shift) + classes[ch]]
+	uint8_t classes[256]; // the column for each byte, every byte has its own until packed
+	int shift;
+	bool *accept; // does the state match the empty string
+	int *marked; // the marks at the front of state i are mark_ids[marked[i]] to mark_ids[marked[i + 1] - 1]
+	int *mark_ids;
+	Names *names; // what the marks in mark_ids are called, the table doesn't own them
+	bool *report; // does entering the state need a callback, because it accepts or has marks
+	int dead; // the one row every dead state was collapsed into, -1 if there are none
+	bool *full; // does the state accept every continuation, see analyse()
+	int start; // row of the pattern it was exported from
+	// a lazy table has a row per derivative met while scanning, and fills a class of
+	// next[] the first time a byte in it is read, every unfilled entry is -1
+	bool lazy;
+	Reg *rows; // the derivative behind each row
+	int *slots; // rows by derivative, open addressed, row + 1 or 0 for empty
+	int nslots, cap;
+	int roots; // rows it was made with, which every scan starts from and a flush keeps
+	long flushes; // how many times it forgot its other rows, see table_flush()
+	int *origin; // the state id - 1 each row of a packed table came from
+};
+typedef struct table Table;
+// fill in the rows of every state labelled in c since t was made, or since the start
+// if t is NULL. rows never change once filled, so a table can keep growing as more
+// patterns are labelled, at the cost of only the new rows
+Table *table_new() {
+	Table *t = calloc(1, sizeof(Table));
+	if(t == NULL)
+		die("out of memory for table");
 	for(int ch = 0; ch < 256; ch++)
-		dfa(r->next[ch]);
+		t->classes[ch] = ch;
+	t->shift = 8;
+	return t;
 }
-void pr(Reg *r) {
-	printf("reg %p ", r);
-	print(r);
-	printf("\n");
+Table *table_extend(Context *c, Table *t) {
+	if(t == NULL)
+		t = table_new();
+	int old = t->states, n = c->nstates;
+	int room = n > 0 ? n : 1; // a context can have no states, when every pattern fell back
+	Reg *states = c->states;
+	uint32_t *fronts = c->fronts;
+	t->next = realloc(t->next, sizeof(int) * 256 * room);
+	t->accept = realloc(t->accept, sizeof(bool) * room);
+	t->full = realloc(t->full, sizeof(bool) * room);
+	t->report = realloc(t->report, sizeof(bool) * room);
+	// marks per state, as the generated matchers used to call them on entry
+	t->marked = realloc(t->marked, sizeof(int) * (n + 1));
+	t->mark_ids = realloc(t->mark_ids, sizeof(int) * (fronts[n] + 1));
+	if(t->next == NULL || t->accept == NULL || t->full == NULL || t->report == NULL || t->marked == NULL || t->mark_ids == NULL)
+		die("out of memory for table");
+	STAT(stats.bytes += (sizeof(int) * 257 + sizeof(bool) * 3) * (n - old) + sizeof(int) * (fronts[n] - fronts[old]));
+	memcpy(&t->mark_ids[fronts[old]], &c->front[fronts[old]], sizeof(int) * (fronts[n] - fronts[old]));
+	for(int i = old; i < n; i++) {
+		t->accept[i] = tags[states[i]].null;
+		t->full[i] = c->fates[i] == FULL;
+		t->marked[i] = fronts[i];
+		t->report[i] = t->accept[i] || fronts[i + 1] > fronts[i];
+		for(int j = 0; j < nedges[states[i]]; j++) {
+			struct edge *e = &edges[states[i]][j];
+			for(int ch = e->lo; ch <= e->hi; ch++)
+				t->next[i * 256 + ch] = row(c, e->to);
+		}
+	}
+	t->marked[n] = fronts[n];
+	t->states = n;
+	t->dead = c->sink;
+	t->names = c->names;
+	return t;
+}
+// an empty table that derives its rows as they're needed, for patterns that ran out
+// of budget. only None and All() are known to be dead and full, and it is not safe
+// to scan with from more than one thread, see table_copy()
+Table *table_lazy(Names *names) {
+	Table *t = table_new();
+	if((t->marked = calloc(1, sizeof(int))) == NULL)
+		die("out of memory for table");
+	t->names = names;
+	t->lazy = true;
+	t->dead = -1;
+	return t;
 }
+// the row for r in a lazy table, added if it's new
+int table_row(Table *t, Reg r) {
+	if(t->states * 2 >= t->nslots) {
+		t->nslots = t->nslots ? t->nslots * 2 : 1024;
+		t->slots = realloc(t->slots, sizeof(int) * t->nslots);
+		if(t->slots == NULL)
+			die("out of memory for table");
+		memset(t->slots, 0, sizeof(int) * t->nslots);
+		for(int i = 0; i < t->states; i++) {
+			uint32_t k = hash(t->rows[i], 0, 0) & (t->nslots - 1);
+			while(t->slots[k] != 0)
+				k = (k + 1) & (t->nslots - 1);
+			t->slots[k] = i + 1;
+		}
+	}
+	uint32_t k = hash(r, 0, 0) & (t->nslots - 1);
+	for(; t->slots[k] != 0; k = (k + 1) & (t->nslots - 1))
+		if(t->rows[t->slots[k] - 1] == r)
+			return t->slots[k] - 1;
+	int n = t->states++;
+	t->slots[k] = n + 1;
+	if(n == t->cap) {
+		t->cap = t->cap ? t->cap * 2 : 64;
+		t->next = realloc(t->next, sizeof(int) * 256 * t->cap);
+		t->accept = realloc(t->accept, sizeof(bool) * t->cap);
+		t->full = realloc(t->full, sizeof(bool) * t->cap);
+		t->report = realloc(t->report, sizeof(bool) * t->cap);
+		t->marked = realloc(t->marked, sizeof(int) * (t->cap + 1));
+		t->rows = realloc(t->rows, sizeof(Reg) * t->cap);
+		if(t->next == NULL || t->accept == NULL || t->full == NULL || t->report == NULL || t->marked == NULL || t->rows == NULL)
+			die("out of memory for table");
+	}
+	int known = t->names ? t->names->n : 0, words = known / 64 + 1, found = 0;
+	uint64_t set[words];
+	memset(set, 0, sizeof(set));
+	front_marks(r, set, words);
+	for(int m = 0; m < known; m++)
+		found += set[m / 64] >> m % 64 & 1;
+	t->mark_ids = realloc(t->mark_ids, sizeof(int) * (t->marked[n] + found + 1));
+	if(t->mark_ids == NULL)
+		die("out of memory for table");
+	t->marked[n + 1] = t->marked[n];
+	for(int m = 0; m < known; m++)
+		if(set[m / 64] >> m % 64 & 1)
+			t->mark_ids[t->marked[n + 1]++] = m;
+	memset(&t->next[n * 256], 0xff, sizeof(int) * 256);
+	t->rows[n] = r;
+	t->accept[n] = tags[r].null;
+	t->full[n] = r == All();
+	t->report[n] = t->accept[n] || found > 0;
+	if(r == None())
+		t->dead = n;
+	STAT(stats.bytes += (sizeof(int) * 257 + sizeof(bool) * 3 + sizeof(Reg)) + sizeof(int) * found);
+	return n;
+}
+// a lazy table keeps at most LAZY_ROWS rows, and then forgets every row but its roots, so
+// scanning a huge DFA doesn't keep every state it passes, or run the node store out of
+// room. the nodes behind the rows it forgot are left for collect(). a scanner's row is
+// only good until the next step, so one that holds on to more than one, like a lane,
+// takes a lazy table one input at a time
+#define LAZY_ROWS (1 << 14)
+void table_flush(Table *t) {
+	t->states = t->roots;
+	for(int i = 0; i < t->roots; i++)
+		memset(&t->next[i * 256], 0xff, sizeof(int) * 256);
+	if(t->dead >= t->roots)
+		t->dead = -1;
+	t->nslots = 0; // so the next table_row() hashes just the roots again
+	t->flushes++;
+}
+// derive row st of a lazy table by ch, filling in every byte of ch's class at once
+int table_fill(Table *t, int st, int ch) {
+	Reg r = t->rows[st], d = derive(ch, r);
+	if(t->states >= LAZY_ROWS) {
+		table_flush(t);
+		if(st >= t->roots) // st is gone, so there's nothing to fill in
+			return table_row(t, d);
+	}
+	int to = table_row(t, d), lo = ch;
+	while(!(bounds[r][lo / 64] >> lo % 64 & 1)) // bound 0 is always set
+		lo--;
+	for(int hi = next_bound(r, ch + 1); lo < hi; lo++)
+		t->next[st * 256 + lo] = to;
+	return to;
+}
+// the row after st on reading ch, every scanner steps through this
+static inline int step(Table *t, int st, unsigned char ch) {
+	int to = t->next[(st << t->shift) + t->classes[ch]];
+	return to >= 0 ? to : table_fill(t, st, ch);
+}
+// lazy tables fill themselves in as they're read, so each thread needs its own
+Table *table_copy(Table *t) {
+	if(!t->lazy)
+		return t;
+	Table *c = table_lazy(t->names);
+	for(int i = 0; i < t->states; i++)
+		table_row(c, t->rows[i]); // the same rows, in the same order
+	c->start = t->start;
+	c->roots = t->roots;
+	return c;
+}
+// a lazy table is all that holds any nodes once a command has made it, so a command
+// scanning with one collects whatever its flushes forgot every now and then
+void table_collect(Table *t) {
+	if(t->lazy && collect_due())
+		collect(t->rows, t->states);
+}
+void table_free(Table *t) {
+	free(t->next);
+	free(t->accept);
+	free(t->full);
+	free(t->report);
+	free(t->marked);
+	free(t->mark_ids);
+	free(t->rows);
+	free(t->slots);
+	free(t->origin);
+	free(t);
+}
+// rows for a packed table, aligned to cache lines. big ones are aligned to huge pages
+// too, and backed by them where the kernel will, so a scan jumping between far apart
+// rows misses the TLB less often
+#define HUGE_PAGE (2 << 20)
+int *table_alloc(size_t bytes) {
+	void *p;
+	size_t align = bytes >= HUGE_PAGE ? HUGE_PAGE : 64;
+	if(posix_memalign(&p, align, (bytes + align - 1) / align * align) != 0)
+		die("out of memory for table");
+#ifdef MADV_HUGEPAGE
+	if(align == HUGE_PAGE)
+		madvise(p, (bytes + align - 1) / align * align, MADV_HUGEPAGE);
 #endif
+	return p;
+}
+// how often each state was visited, and left by each byte, while scanning a sample of
+// real input with search_profiled(). states are by id - 1, which is the same from run
+// to run for the same pattern and command, and a profile only applies to a table with
+// the same number of states, for the regex it was written for. a byte stands for every
+// byte in its class
+struct profile {
+	int states;
+	long *visits;
+	int *at; // the transitions out of state i are bytes[at[i]] to bytes[at[i + 1] - 1]
+	uint8_t *bytes;
+	long *uses;
+} *profile = NULL; // used by table_pack() when set, see --profile
+// the regex a profile is for, as it was written, since states of two regexes with as many
+// of them have nothing to do with each other
+uint32_t pattern_hash(char *s) {
+	uint32_t h = 0;
+	for(; *s != '\0'; s++)
+		h = hash(h, (unsigned char)*s, 0);
+	return h;
+}
+// regex is the one the tables will be made from, it must be read before parse() writes into it
+void profile_load(char *path, char *regex) {
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		die("can't open profile %s", path);
+	struct profile *p = calloc(1, sizeof(struct profile));
+	long n = 0, cap = 1024;
+	int last = -1;
+	char *line = NULL;
+	size_t size = 0;
+	uint32_t h;
+	if(p == NULL || fscanf(f, "regdx profile %i %x\n", &p->states, &h) != 2 || p->states < 0 || p->states > CACHE_SIZE)
+		die("%s isn't a profile", path);
+	if(h != pattern_hash(regex)) {
+		fprintf(stderr, "profile %s is for another regex, ignoring it\n", path);
+		free(p);
+		fclose(f);
+		return;
+	}
+	p->visits = calloc(p->states, sizeof(long));
+	p->at = calloc(p->states + 1, sizeof(int));
+	p->bytes = malloc(cap);
+	p->uses = malloc(sizeof(long) * cap);
+	if(p->visits == NULL || p->at == NULL || p->bytes == NULL || p->uses == NULL)
+		die("out of memory for profile");
+	// a line per visited state in order, "state visits byte:uses byte:uses..."
+	while(getline(&line, &size, f) > 0) {
+		char *s = line;
+		int state = strtol(s, &s, 10);
+		if(state <= last || state >= p->states)
+			die("profile %s has states out of order", path);
+		for(int i = last + 1; i <= state; i++)
+			p->at[i] = n;
+		last = state;
+		p->visits[state] = strtol(s, &s, 10);
+		while(*s == ' ') {
+			int byte = strtol(s, &s, 10);
+			if(*s++ != ':' || byte < 0 || byte > 255)
+				die("profile %s has a bad transition for state %i", path, state);
+			if(n == cap) {
+				cap *= 2;
+				p->bytes = realloc(p->bytes, cap);
+				p->uses = realloc(p->uses, sizeof(long) * cap);
+				if(p->bytes == NULL || p->uses == NULL)
+					die("out of memory for profile");
+			}
+			p->bytes[n] = byte;
+			p->uses[n++] = strtol(s, &s, 10);
+		}
+	}
+	free(line);
+	for(int i = last + 1; i <= p->states; i++)
+		p->at[i] = n;
+	fclose(f);
+	profile = p;
+}
+int by_visits(const void *a, const void *b) {
+	long x = profile->visits[*(int *)a], y = profile->visits[*(int *)b];
+	return (x < y) - (x > y);
+}
+// the rows of t in profile order, hottest first, each followed by the chain of its most
+// used successors, so a scan mostly steps to a row next to the one it's in. rows that
+// were never visited are left for table_pack() to put after all of them
+int profile_order(Table *t, int *renum, int *order, int m) {
+	int *hot = malloc(sizeof(int) * t->states), nhot = 0;
+	if(hot == NULL)
+		die("out of memory for profile");
+	for(int i = 0; i < t->states; i++)
+		if(profile->visits[i] > 0)
+			hot[nhot++] = i;
+	qsort(hot, nhot, sizeof(int), by_visits);
+	for(int h = 0; h < nhot; h++)
+		for(int i = hot[h]; i >= 0;) {
+			if(renum[i] < 0) {
+				renum[i] = m;
+				order[m++] = i;
+			}
+			int best = -1;
+			long most = 0;
+			for(int k = profile->at[i]; k < profile->at[i + 1]; k++) {
+				int to = t->next[(i << t->shift) + t->classes[profile->bytes[k]]];
+				if(renum[to] < 0 && profile->uses[k] > most) {
+					best = to;
+					most = profile->uses[k];
+				}
+			}
+			i = best;
+		}
+	free(hot);
+	return m;
+}
+// a copy of t laid out for scanning from roots, which are renumbered to match. bytes that
+// every row treats alike share a column, rows are a power of two columns wide so small
+// ones never straddle a cache line, and rows are numbered breadth first from the roots,
+// so the states near them, where most scans spend their time, sit together. rows the
+// roots can't reach are left out, so a packed table can't be extended
+Table *table_pack(Table *t, int *roots, int nroots) {
+	if(t->lazy)
+		return t;
+	TRACE_BEGIN("pack");
+	Table *p = table_new();
+	p->names = t->names;
+	// bytes with the same column hash are compared in full with the first byte of each column
+	uint32_t h[256];
+	int first[256], n = 0;
+	for(int ch = 0; ch < 256; ch++) {
+		h[ch] = 0;
+		for(int i = 0; i < t->states; i++)
+			h[ch] = (h[ch] ^ t->next[(i << t->shift) + t->classes[ch]]) * 0x9e3779b1;
+		int k = 0;
+		for(; k < n; k++) {
+			if(h[first[k]] != h[ch])
+				continue;
+			int i = 0;
+			while(i < t->states && t->next[(i << t->shift) + t->classes[ch]] == t->next[(i << t->shift) + t->classes[first[k]]])
+				i++;
+			if(i == t->states)
+				break;
+		}
+		if(k == n)
+			first[n++] = ch;
+		p->classes[ch] = k;
+	}
+	for(p->shift = 0; 1 << p->shift < n; p->shift++);
+	// breadth first from the roots, renum[i] is the new number of row i, -1 if unreachable
+	int *renum = malloc(sizeof(int) * t->states), *order = malloc(sizeof(int) * t->states), m = 0;
+	if(renum == NULL || order == NULL)
+		die("out of memory for packing");
+	memset(renum, 0xff, sizeof(int) * t->states);
+	for(int r = 0; r < nroots; r++)
+		if(renum[roots[r]] < 0) {
+			renum[roots[r]] = m;
+			order[m++] = roots[r];
+		}
+	// with a profile, the rows it saw come next in its order, and the rest after them
+	if(profile != NULL && profile->states == t->states && t->origin == NULL)
+		m = profile_order(t, renum, order, m);
+	else if(profile != NULL)
+		fprintf(stderr, "profile is for %i states, not %i, ignoring it\n", profile->states, t->states);
+	for(int q = 0; q < m; q++)
+		for(int k = 0; k < n; k++) {
+			int to = t->next[(order[q] << t->shift) + t->classes[first[k]]];
+			if(renum[to] < 0) {
+				renum[to] = m;
+				order[m++] = to;
+			}
+		}
+	size_t bytes = (sizeof(int) << p->shift) * m;
+	p->next = table_alloc(bytes);
+	memset(p->next, 0, bytes);
+	p->accept = malloc(sizeof(bool) * m);
+	p->full = malloc(sizeof(bool) * m);
+	p->report = malloc(sizeof(bool) * m);
+	p->marked = malloc(sizeof(int) * (m + 1));
+	p->mark_ids = malloc(sizeof(int) * (t->marked[t->states] + 1));
+	p->origin = malloc(sizeof(int) * m);
+	if(p->accept == NULL || p->full == NULL || p->report == NULL || p->marked == NULL || p->mark_ids == NULL || p->origin == NULL)
+		die("out of memory for table");
+	STAT(stats.bytes += bytes + (sizeof(int) + sizeof(bool) * 3) * m);
+	p->marked[0] = 0;
+	for(int q = 0; q < m; q++) {
+		int i = order[q];
+		for(int k = 0; k < n; k++)
+			p->next[(q << p->shift) + k] = renum[t->next[(i << t->shift) + t->classes[first[k]]]];
+		p->accept[q] = t->accept[i];
+		p->full[q] = t->full[i];
+		p->report[q] = t->report[i];
+		p->origin[q] = t->origin != NULL ? t->origin[i] : i;
+		int own = t->marked[i + 1] - t->marked[i];
+		memcpy(&p->mark_ids[p->marked[q]], &t->mark_ids[t->marked[i]], sizeof(int) * own);
+		p->marked[q + 1] = p->marked[q] + own;
+	}
+	p->states = m;
+	p->dead = t->dead >= 0 ? renum[t->dead] : -1;
+	p->start = renum[t->start];
+	for(int r = 0; r < nroots; r++)
+		roots[r] = renum[roots[r]];
+	free(renum);
+	free(order);
+	TRACE_END("pack");
+	return p;
+}
+Table *export(Context *c, Reg r) {
+	TRACE_BEGIN("export");
+	Table *t;
+	if(label(c, r)) {
+		Table *all = table_extend(c, NULL); // every state c has labelled, not just r's
+		all->start = row(c, r);
+		t = table_pack(all, &all->start, 1);
+		table_free(all);
+	} else {
+		t = table_lazy(c->names);
+		t->start = table_row(t, r);
+		t->roots = t->states;
+	}
+	TRACE_END("export");
+	return t;
+}
+// the row after reading s from row st, stopping early once nothing more can change the answer,
+// and with early set as soon as a match ends. a long input can be walked a piece at a time
+int table_walk(Table *t, int st, char *s, size_t len, bool early) {
+	for(size_t i = 0; i < len && st != t->dead && !t->full[st] && !(early && t->accept[st]); i++)
+		st = step(t, st, s[i]);
+	return st;
+}
+// anchored match of the whole of s against the table, starting from the state r was exported from
+bool table_match(Table *t, int start, char *s, size_t len) {
+	return t->accept[table_walk(t, start, s, len, false)];
+}
+// unanchored search at table speed, from three roots sharing one table: .*r forwards
+// finds where matches end, .*Reverse(r) backwards from an end finds where they start,
+// and r forwards from a start finds its longest end. every pass is linear
+struct finder {
+	Table *t;
+	int search, reverse, anchored; // rows to start .*r, .*Reverse(r) and r from
+	bool *starts; // scratch for find_all(), starts[i] is set if a match starts at i
+	int *seen; // and the row its last walk forwards was in after byte i, see find_end()
+	size_t cap;
+};
+typedef struct finder Finder;
+Finder *finder(Context *c, Reg r) {
+	Reg search = Seq(All(), r), reverse = Seq(All(), Reverse(r));
+	Finder *f = calloc(1, sizeof(Finder));
+	if(f == NULL)
+		die("out of memory for finder");
+	if(label(c, search) && label(c, reverse) && label(c, r)) {
+		Table *all = table_extend(c, NULL); // takes every state c has labelled
+		int roots[3] = { c->ids[search] - 1, c->ids[reverse] - 1, c->ids[r] - 1 };
+		all->start = roots[2];
+		f->t = table_pack(all, roots, 3);
+		table_free(all);
+		f->search = roots[0];
+		f->reverse = roots[1];
+		f->anchored = roots[2];
+	} else {
+		// if any root is out of budget, all three share a lazy table instead
+		f->t = table_lazy(c->names);
+		f->search = table_row(f->t, search);
+		f->reverse = table_row(f->t, reverse);
+		f->anchored = table_row(f->t, r);
+		f->t->roots = f->t->states;
+	}
+	f->t->start = f->anchored;
+	return f;
+}
+// does s contain a match anywhere, stopping at the first accepting state
+bool search(Finder *f, char *s, size_t len) {
+	return f->t->accept[table_walk(f->t, f->search, s, len, true)];
+}
+// search() counting every row it enters in visits[row], and every column it leaves
+// a row by in uses[(row << t->shift) + column], for profile_write()
+bool search_profiled(Finder *f, char *s, size_t len, long *visits, long *uses) {
+	Table *t = f->t;
+	int st = f->search;
+	visits[st]++;
+	for(size_t i = 0; i < len && !t->accept[st] && st != t->dead; i++) {
+		uses[(st << t->shift) + t->classes[(unsigned char)s[i]]]++;
+		st = step(t, st, s[i]);
+		visits[st]++;
+	}
+	return t->accept[st];
+}
+// save the counts of a packed table by the states of c its rows came from, see profile_load()
+// regex is the hash of the regex it was made from, see pattern_hash()
+void profile_write(Context *c, Table *t, uint32_t regex, long *visits, long *uses, char *path) {
+	int nstates = c->nstates;
+	FILE *f = fopen(path, "w");
+	if(f == NULL || t->origin == NULL)
+		die("can't write profile %s", path);
+	int *rows = malloc(sizeof(int) * nstates), first[256];
+	if(rows == NULL)
+		die("out of memory for profile");
+	memset(rows, 0xff, sizeof(int) * nstates);
+	for(int q = 0; q < t->states; q++)
+		rows[t->origin[q]] = q;
+	for(int ch = 255; ch >= 0; ch--)
+		first[t->classes[ch]] = ch;
+	fprintf(f, "regdx profile %i %08x\n", nstates, regex);
+	for(int i = 0; i < nstates; i++) {
+		int q = rows[i];
+		if(q < 0 || visits[q] == 0)
+			continue;
+		fprintf(f, "%i %li", i, visits[q]);
+		for(int k = 0; k < 1 << t->shift; k++)
+			if(uses[(q << t->shift) + k] > 0)
+				fprintf(f, " %i:%li", first[k], uses[(q << t->shift) + k]);
+		fprintf(f, "\n");
+	}
+	free(rows);
+	fclose(f);
+}
+// many independent inputs at once, out[i] is whether s[i] matched. one input's steps
+// each wait on the load before, so LANES of them are stepped in turn, and the row each
+// lane reads next is prefetched while the others step. a lane that finishes takes
+// the next input straight away. early stops a lane at its first accepting state
+#define LANES 8
+void table_batch(Table *t, int start, bool early, char **s, size_t *len, size_t n, bool *out) {
+	int st[LANES], width = t->lazy ? 1 : LANES; // see table_flush()
+	size_t at[LANES], which[LANES], taken = 0;
+	for(int lanes = 0;;) {
+		for(; lanes < width && taken < n; lanes++, taken++) {
+			which[lanes] = taken;
+			st[lanes] = start;
+			at[lanes] = 0;
+		}
+		if(lanes == 0)
+			break;
+		for(int k = 0; k < lanes; k++) {
+			int q = st[k];
+			char *in = s[which[k]];
+			size_t end = len[which[k]];
+			if(at[k] == end || q == t->dead || t->full[q] || (early && t->accept[q])) {
+				out[which[k]] = t->accept[q];
+				// the last lane moves into this one, and is stepped in its place
+				lanes--;
+				st[k] = st[lanes];
+				at[k] = at[lanes];
+				which[k] = which[lanes];
+				k--;
+				continue;
+			}
+			q = st[k] = step(t, q, in[at[k]++]);
+			if(at[k] < end)
+				__builtin_prefetch(&t->next[(q << t->shift) + t->classes[(unsigned char)in[at[k]]]]);
+		}
+	}
+}
+// a column of short strings at once, stored the usual way with row i from data[offsets[i]]
+// to data[offsets[i + 1] - 1]. selected gets bit i set if row i matched in full, and
+// mark[i] is the first mark at the end of row i if it matched, -1 otherwise, either can
+// be NULL. LANES stretches of rows are stepped in turn like table_batch(), and when the
+// rows are sorted each resumes from the state at the end of the prefix it shares with
+// the row before, so a column of URLs or keys steps through a common prefix only once
+struct lane {
+	size_t row, hi; // next row to do, and the end of the lane's stretch
+	char *s; // the row being done, or the one before once it's finished
+	size_t at, len;
+	int st;
+	int *path; // path[i] is the state after i bytes of s, up to walked
+	size_t walked, cap;
+};
+// start l on its next row, false if it has none left
+bool lane_next(struct lane *l, int start, char *data, size_t *offsets, bool sorted) {
+	if(l->row == l->hi)
+		return false;
+	char *s = data + offsets[l->row];
+	size_t len = offsets[l->row + 1] - offsets[l->row], at = 0;
+	if(sorted && l->s != NULL)
+		while(at < l->walked && at < len && s[at] == l->s[at])
+			at++;
+	if(len + 1 > l->cap) {
+		l->cap = (len + 1) * 2;
+		l->path = realloc(l->path, sizeof(int) * l->cap);
+		if(l->path == NULL)
+			die("out of memory for lanes");
+	}
+	l->path[0] = start;
+	l->s = s;
+	l->len = len;
+	l->at = at;
+	l->st = l->path[at];
+	return true;
+}
+// record the result of a row, which ended in state q
+static inline void select_row(Table *t, size_t row, int q, uint64_t *selected, int *mark) {
+	bool hit = t->accept[q];
+	if(hit && selected != NULL)
+		selected[row / 64] |= 1ULL << row % 64;
+	if(mark != NULL)
+		mark[row] = hit && t->marked[q + 1] > t->marked[q] ? t->mark_ids[t->marked[q]] : -1;
+}
+// lanes only pay off once rows start missing the cache, below this rows go one at a time
+#define CACHED_TABLE (256 << 10)
+void table_select(Table *t, int start, char *data, size_t *offsets, size_t rows, bool sorted, uint64_t *selected, int *mark) {
+	if(selected != NULL)
+		memset(selected, 0, sizeof(uint64_t) * ((rows + 63) / 64));
+	bool cached = sizeof(int) * ((size_t)t->states << t->shift) <= CACHED_TABLE;
+	if(t->lazy || (cached && !sorted)) { // a lazy table's rows don't last, see table_flush()
+		for(size_t i = 0; i < rows; i++) {
+			char *s = data + offsets[i];
+			size_t len = offsets[i + 1] - offsets[i];
+			int q = start;
+			for(size_t at = 0; at < len && q != t->dead && !t->full[q]; at++)
+				q = step(t, q, s[at]);
+			select_row(t, i, q, selected, mark);
+		}
+		return;
+	}
+	if(cached) {
+		struct lane l = { .row = 0, .hi = rows };
+		while(lane_next(&l, start, data, offsets, sorted)) {
+			int q = l.st;
+			size_t at = l.at;
+			for(; at < l.len && q != t->dead && !t->full[q]; at++)
+				l.path[at + 1] = q = step(t, q, l.s[at]);
+			l.walked = at;
+			select_row(t, l.row++, q, selected, mark);
+		}
+		free(l.path);
+		return;
+	}
+	struct lane ls[LANES];
+	int n = 0;
+	for(int k = 0; k < LANES; k++) {
+		ls[n] = (struct lane){ .row = rows * k / LANES, .hi = rows * (k + 1) / LANES };
+		n += lane_next(&ls[n], start, data, offsets, sorted);
+	}
+	while(n > 0)
+		for(int k = 0; k < n; k++) {
+			struct lane *l = &ls[k];
+			int q = l->st;
+			if(l->at == l->len || q == t->dead || t->full[q]) {
+				l->walked = l->at;
+				select_row(t, l->row++, q, selected, mark);
+				if(!lane_next(l, start, data, offsets, sorted)) {
+					// the last lane moves into this one, and is stepped in its place
+					free(l->path);
+					ls[k--] = ls[--n];
+				}
+				continue;
+			}
+			q = l->st = step(t, q, l->s[l->at++]);
+			if(sorted)
+				l->path[l->at] = q;
+			if(l->at < l->len)
+				__builtin_prefetch(&t->next[(q << t->shift) + t->classes[(unsigned char)l->s[l->at]]]);
+		}
+}
+void table_match_batch(Table *t, int start, char **s, size_t *len, size_t n, bool *out) {
+	table_batch(t, start, false, s, len, n, out);
+}
+void search_batch(Finder *f, char **s, size_t *len, size_t n, bool *out) {
+	table_batch(f->t, f->search, true, s, len, n, out);
+}
+// the leftmost start of any match ending at end, not looking before from
+size_t find_start(Finder *f, char *s, size_t from, size_t end) {
+	Table *t = f->t;
+	size_t lo = end;
+	int st = f->reverse;
+	for(size_t i = end; i-- > from && st != t->dead;) {
+		st = step(t, st, s[i]);
+		if(t->full[st])
+			return from;
+		if(t->accept[st])
+			lo = i;
+	}
+	return lo;
+}
+// the end of the longest match starting at start, not looking past last
+// seen, unless it's NULL, has the row an earlier walk was in after each byte, or -1. they
+// all ended by start, so they found no end past it, and from a row and place one of
+// them was in, this walk can't either
+// rows seen before a lazy table flushed aren't the same rows after, see table_flush()
+size_t find_end(Finder *f, char *s, size_t start, size_t last, int *seen) {
+	Table *t = f->t;
+	size_t hi = start;
+	int st = f->anchored;
+	long flushes = t->flushes;
+	for(size_t i = start; i < last && st != t->dead; i++) {
+		st = step(t, st, s[i]);
+		if(t->full[st])
+			return last;
+		if(t->accept[st])
+			hi = i + 1;
+		if(seen != NULL && t->flushes == flushes) {
+			if(seen[i] == st)
+				return hi;
+			seen[i] = st;
+		}
+	}
+	return hi;
+}
+// find the leftmost-longest match in s at or after from, false if there isn't one
+bool find(Finder *f, char *s, size_t len, size_t from, size_t *start, size_t *end) {
+	Table *t = f->t;
+	// no match can end after last
+	long last = -1;
+	int st = f->search;
+	if(t->accept[st])
+		last = from;
+	for(size_t i = from; i < len && st != t->dead; i++) {
+		st = step(t, st, s[i]);
+		if(t->full[st]) {
+			last = len;
+			break;
+		}
+		if(t->accept[st])
+			last = i + 1;
+	}
+	if(last < 0)
+		return false;
+	// so walking back from there passes every start, and some match from the leftmost ends by last
+	*start = find_start(f, s, from, last);
+	*end = find_end(f, s, *start, last, NULL);
+	return true;
+}
+// find the match that ends first in s at or after from, and its leftmost start
+// the scan stops as soon as any match ends, so this never looks further than it has to
+bool find_earliest(Finder *f, char *s, size_t len, size_t from, size_t *start, size_t *end) {
+	Table *t = f->t;
+	int st = f->search;
+	size_t i = from;
+	for(; i < len && !t->accept[st] && st != t->dead; i++)
+		st = step(t, st, s[i]);
+	if(!t->accept[st])
+		return false;
+	*start = find_start(f, s, from, i);
+	*end = i;
+	return true;
+}
+// call each() on every non-overlapping match in s, leftmost-longest or earliest first
+// one backwards pass over the whole line marks every start, so finding the next match
+// is just a walk forwards from the last one. a walk can't stop at its longest match
+// until the pattern is dead though, so a walk stops early once it meets an earlier one
+// instead. that's linear for patterns whose walks meet, like a|a.*z, but a pattern
+// whose walks stay apart, remembering where they started, can still take quadratic time
+int find_all(Finder *f, char *s, size_t len, bool earliest, void (*each)(char *s, size_t start, size_t end)) {
+	int n = 0;
+	size_t start, end;
+	if(earliest) {
+		for(size_t from = 0; from <= len && find_earliest(f, s, len, from, &start, &end); n++) {
+			each(s, start, end);
+			from = end > from ? end : from + 1;
+		}
+		return n;
+	}
+	if(len + 1 > f->cap) {
+		f->cap = (len + 1) * 2;
+		f->starts = realloc(f->starts, sizeof(bool) * f->cap);
+		f->seen = realloc(f->seen, sizeof(int) * f->cap);
+		if(f->starts == NULL || f->seen == NULL)
+			die("out of memory for match starts");
+	}
+	memset(f->seen, 0xff, sizeof(int) * len);
+	Table *t = f->t;
+	int st = f->reverse;
+	f->starts[len] = t->accept[st];
+	for(size_t i = len; i-- > 0;) {
+		st = step(t, st, s[i]);
+		// nothing further back can change once the state is dead or full
+		if(st == t->dead || t->full[st]) {
+			memset(f->starts, t->full[st], i + 1);
+			break;
+		}
+		f->starts[i] = t->accept[st];
+	}
+	for(size_t from = 0; from <= len; n++) {
+		while(from <= len && !f->starts[from])
+			from++;
+		if(from > len)
+			break;
+		start = from;
+		long flushes = t->flushes;
+		end = find_end(f, s, start, len, f->seen);
+		if(t->flushes != flushes)
+			memset(f->seen, 0xff, sizeof(int) * len);
+		each(s, start, end);
+		from = end > start ? end : start + 1;
+	}
+	return n;
+}
+// same as table_match, but walks derivatives lazily without building the DFA first
+bool derive_match(Reg r, char *s, size_t len) {
+	for(size_t i = 0; i < len; i++)
+		r = derive((unsigned char)s[i], r);
+	return tags[r].null;
+}
+#endif
+#if 1 // glushkov
+// a bit parallel simulation of the position automaton, for small patterns without & or !,
+// which needs no derivatives at all. bit 0 is the start and every other bit is one
+// occurrence of a set of bytes in the pattern, so a step follows every live position at once
+#define POSITIONS 64
+struct glushkov {
+	int n; // positions, counting the start
+	bool linear; // every position only follows the one before it, so a step is a shift
+	uint64_t last; // positions a match can end at
+	uint64_t masks[256]; // positions whose LIT holds each byte
+	uint64_t (*follow)[256]; // follow[k][b] is every position that follows one of bits k * 8 + i of b
+};
+typedef struct glushkov Glushkov;
+struct part {
+	uint64_t first, last; // positions the part can start and end at
+	bool null;
+};
+// or the bytes into set if r only matches single bytes, like [^a], which parses to
+// And(Lit(0, 256), Not(Lit(97, 1))), or a|b
+bool byteset(Reg r, uint64_t *set) {
+	uint64_t in[4], all[4] = { ~0ULL, ~0ULL, ~0ULL, ~0ULL };
+	bool any = false;
+	switch(tags[r].type) {
+		case LIT:
+			for(uint ch = links[r].ch; ch < links[r].ch + links[r].len; ch++)
+				set[ch / 64] |= 1ULL << ch % 64;
+		return true;
+		case OR:
+			for(int i = 0; i < links[r].n; i++)
+				if(!byteset(children(r)[i], set))
+					return false;
+		return true;
+		case AND:
+			// at least one side has to be bytes, the others can be bytes or their complement
+			for(int i = 0; i < links[r].n; i++) {
+				Reg c = children(r)[i];
+				bool not = tags[c].type == NOT;
+				memset(in, 0, sizeof(in));
+				if(!byteset(not ? links[c].head : c, in))
+					return false;
+				for(int k = 0; k < 4; k++)
+					all[k] &= not ? ~in[k] : in[k];
+				any |= !not;
+			}
+			for(int k = 0; k < 4; k++)
+				set[k] |= all[k];
+		return any;
+		default:
+		return false;
+	}
+}
+// number the positions of r, adding the follow sets inside it to follows
+// every occurrence of a shared node gets its own positions, so this walks the tree
+// returns false if r has & or !, or too many positions
+bool positions(Glushkov *g, uint64_t *follows, Reg r, struct part *p) {
+	struct part a, b;
+	uint64_t set[4] = { 0 };
+	if(tags[r].type == ALL || byteset(r, set)) {
+		// any single byte set is one position, .* is one that loops on itself
+		if(g->n == POSITIONS)
+			return false;
+		uint64_t bit = 1ULL << g->n++;
+		bool all = tags[r].type == ALL;
+		for(int ch = 0; ch < 256; ch++)
+			if(all || set[ch / 64] >> ch % 64 & 1)
+				g->masks[ch] |= bit;
+		if(all)
+			follows[g->n - 1] |= bit;
+		*p = (struct part){ bit, bit, all };
+		return true;
+	}
+	switch(tags[r].type) {
+		case EMPTY:
+		case MARK: // marks are only reported by tables, here they're just empty
+			*p = (struct part){ 0, 0, true };
+		return true;
+		case NONE:
+			*p = (struct part){ 0, 0, false };
+		return true;
+		case INF:
+			if(!positions(g, follows, links[r].head, p))
+				return false;
+			for(uint64_t l = p->last; l != 0; l &= l - 1)
+				follows[__builtin_ctzll(l)] |= p->first;
+			p->null = true;
+		return true;
+		case SEQ:
+			if(!positions(g, follows, links[r].head, &a) || !positions(g, follows, links[r].tail, &b))
+				return false;
+			for(uint64_t l = a.last; l != 0; l &= l - 1)
+				follows[__builtin_ctzll(l)] |= b.first;
+			*p = (struct part){ a.first | (a.null ? b.first : 0), b.last | (b.null ? a.last : 0), a.null && b.null };
+		return true;
+		case OR:
+			*p = (struct part){ 0, 0, false };
+			for(int i = 0; i < links[r].n; i++) {
+				if(!positions(g, follows, children(r)[i], &a))
+					return false;
+				p->first |= a.first;
+				p->last |= a.last;
+				p->null |= a.null;
+			}
+		return true;
+		default: // NOT, and AND of more than bytes
+		return false;
+	}
+}
+// NULL if r can't be simulated this way
+Glushkov *glushkov(Reg r) {
+	Glushkov *g = calloc(1, sizeof(Glushkov));
+	if(g == NULL)
+		die("out of memory for glushkov");
+	uint64_t follows[POSITIONS] = { 0 };
+	struct part p;
+	g->n = 1;
+	if(!positions(g, follows, r, &p)) {
+		free(g);
+		return NULL;
+	}
+	follows[0] = p.first;
+	g->last = p.last | p.null; // the start is bit 0
+	g->linear = true;
+	for(int i = 0; i < g->n; i++)
+		g->linear &= follows[i] == (i + 1 < g->n ? 2ULL << i : 0);
+	// a byte of live positions at a time, each entry built from the one without its lowest bit
+	int chunks = (g->n + 7) / 8;
+	g->follow = calloc(chunks, sizeof(*g->follow));
+	if(g->follow == NULL)
+		die("out of memory for glushkov");
+	for(int k = 0; k < chunks; k++)
+		for(int b = 1; b < 256; b++)
+			g->follow[k][b] = g->follow[k][b & (b - 1)] | follows[k * 8 + __builtin_ctz(b)];
+	STAT(stats.bytes += sizeof(Glushkov) + sizeof(*g->follow) * chunks);
+	return g;
+}
+static inline uint64_t glushkov_step(Glushkov *g, uint64_t d, unsigned char ch) {
+	uint64_t to = 0;
+	if(g->linear) // plain shift-and
+		to = d << 1;
+	else
+		for(int k = 0; d != 0; k++, d >>= 8)
+			to |= g->follow[k][d & 255];
+	return to & g->masks[ch];
+}
+// anchored match of the whole of s
+bool glushkov_match(Glushkov *g, char *s, size_t len) {
+	uint64_t d = 1;
+	for(size_t i = 0; i < len && d != 0; i++)
+		d = glushkov_step(g, d, s[i]);
+	return (d & g->last) != 0;
+}
+// does s contain a match anywhere, the start stays live so a match can begin at any byte
+bool glushkov_search(Glushkov *g, char *s, size_t len) {
+	uint64_t d = 1;
+	for(size_t i = 0; i < len && !(d & g->last); i++)
+		d = glushkov_step(g, d, s[i]) | 1;
+	return (d & g->last) != 0;
+}
+// the cost model picking a backend per pattern, counted in DFA table steps as measured
+// on the bench corpus. the DFA pays a derive() per class of every state before reading
+// anything, guessing a state per position, then a step per byte. a linear glushkov step
+// is about half a table step, otherwise a third of one per byte of positions, plus one
+#define DERIVE_STEPS 125
+bool prefer_glushkov(Glushkov *g, Reg r, size_t bytes) {
+	if(g == NULL)
+		return false;
+	double per_byte = g->linear ? 0.5 : ((g->n + 7) / 8 + 1) / 3.0;
+	double dfa = (double)g->n * classes(r) * DERIVE_STEPS + bytes;
+	return bytes * per_byte <= dfa;
+}
+#endif
+#if 1 // stream
+// matching over data that arrives in pieces, like from a socket or a pipe. everything
+// that has to survive between pieces lives in the caller's struct stream, so feeding
+// never copies the data or allocates
+#define RDX_MATCH (-1) // mark given to the callback when a match ends
+// called with a mark id (its name is in the table's names) when a state with that mark at its
+// front is entered, or RDX_MATCH when a match ends, offset counts from the stream start
+typedef void (*rdx_callback)(void *ctx, int mark, size_t offset);
+struct stream {
+	Table *t; // any number of streams can share a packed one, but a lazy one fills in as it's read
+	int state;
+	size_t offset; // bytes fed so far
+	long last; // where the last match ended, -1 if none has
+	bool pending; // the start state hasn't been reported, since init() has no callback
+	void *ctx; // passed through to the callback
+};
+// start is a row of t, a finder's search row to find matches anywhere in the stream,
+// or its anchored row to match from the stream start only
+void stream_init(struct stream *s, Table *t, int start, void *ctx) {
+	s->t = t;
+	s->state = start;
+	s->offset = 0;
+	s->last = -1;
+	s->pending = t->report[start];
+	s->ctx = ctx;
+}
+void stream_report(struct stream *s, rdx_callback callback) {
+	Table *t = s->t;
+	for(int i = t->marked[s->state]; i < t->marked[s->state + 1]; i++)
+		callback(s->ctx, t->mark_ids[i], s->offset);
+	if(t->accept[s->state]) {
+		s->last = s->offset;
+		callback(s->ctx, RDX_MATCH, s->offset);
+	}
+}
+void stream_feed(struct stream *s, char *buf, size_t len, rdx_callback callback) {
+	Table *t = s->t;
+	if(s->pending) {
+		s->pending = false;
+		stream_report(s, callback);
+	}
+	// the state and offset are kept in locals, and only written back for callbacks
+	int st = s->state;
+	size_t offset = s->offset;
+	for(size_t i = 0; i < len && st != t->dead; i++) {
+		st = step(t, st, buf[i]);
+		if(t->report[st]) {
+			s->state = st;
+			s->offset = offset + i + 1;
+			stream_report(s, callback);
+		}
+	}
+	s->state = st;
+	s->offset = offset + len;
+}
+// returns where the last match ended, -1 if none did. an anchored stream matched
+// in full if that's the same as s->offset
+long stream_finish(struct stream *s, rdx_callback callback) {
+	if(s->pending) {
+		s->pending = false;
+		stream_report(s, callback);
+	}
+	return s->last;
+}
+#endif
+#if 1 // rules
+// a long-lived set of named patterns that are matched all at once, and can be added
+// and removed a few at a time. every node and derivative an older set made stays
+// interned and cached, so rebuilding only derives the product states that are new,
+// and the table only gains rows for them. every state of one automaton involves
+// every rule though, so rules are split into groups with an automaton each, and a
+// change only rebuilds its own group, at the cost of a pass per group when matching
+#define GROUP (32)
+struct group {
+	int n;
+	char *names[GROUP]; // rule i's name, which is also the name of its mark
+	Reg rules[GROUP]; // rule i's pattern followed by its mark
+	char *sources[GROUP]; // rule i's pattern as it was given, see rules_collect()
+	bool dirty; // changed since the last build
+	int start; // row to search from, matches can be anywhere in the input
+	Table *t; // its own lazy table if it ran out of budget, NULL if it uses the shared one
+};
+struct rules {
+	int ngroups, cap;
+	struct group *groups;
+	Names names; // of every rule, and every mark in their patterns
+	bool *ruled; // ruled[m] if mark m is a rule's own, for marks below nruled
+	int nruled;
+	Table *t; // shared by every group, and grows with every build
+	Context *c; // where every group is labelled, so the table can keep growing
+};
+typedef struct rules Rules;
+Rules *rules_new() {
+	Rules *s = calloc(1, sizeof(Rules));
+	if(s == NULL)
+		die("out of memory for rules");
+	s->c = context_new(&s->names);
+	return s;
+}
+// the mark of the rule with this name, so a rule that comes back gets its old nodes back
+// too. the marks written in patterns share the names, but never a rule's mark
+int rule_mark(Rules *s, char *name) {
+	for(int i = 0; i < s->nruled; i++)
+		if(s->ruled[i] && strcmp(s->names.name[i], name) == 0)
+			return i;
+	int m = name_mark(&s->names, name, strlen(name));
+	s->ruled = realloc(s->ruled, sizeof(bool) * s->names.n);
+	if(s->ruled == NULL)
+		die("out of memory for rules");
+	memset(&s->ruled[s->nruled], 0, sizeof(bool) * (s->names.n - s->nruled));
+	s->nruled = s->names.n;
+	s->ruled[m] = true;
+	return m;
+}
+bool rules_remove(Rules *s, char *name) {
+	for(int g = 0; g < s->ngroups; g++) {
+		struct group *gr = &s->groups[g];
+		for(int i = 0; i < gr->n; i++)
+			if(strcmp(gr->names[i], name) == 0) {
+				free(gr->names[i]);
+				free(gr->sources[i]);
+				memmove(&gr->names[i], &gr->names[i + 1], sizeof(char *) * (gr->n - i - 1));
+				memmove(&gr->sources[i], &gr->sources[i + 1], sizeof(char *) * (gr->n - i - 1));
+				memmove(&gr->rules[i], &gr->rules[i + 1], sizeof(Reg) * (gr->n - i - 1));
+				gr->n--;
+				gr->dirty = true;
+				return true;
+			}
+	}
+	return false;
+}
+// adding a rule under a name that's already there replaces it
+void rules_add(Rules *s, char *name, char *src) {
+	rules_remove(s, name);
+	int g = 0;
+	while(g < s->ngroups && s->groups[g].n == GROUP)
+		g++;
+	if(g == s->ngroups) {
+		if(s->ngroups == s->cap) {
+			s->cap = s->cap ? s->cap * 2 : 4;
+			s->groups = realloc(s->groups, sizeof(struct group) * s->cap);
+			if(s->groups == NULL)
+				die("out of memory for rules");
+		}
+		memset(&s->groups[s->ngroups++], 0, sizeof(struct group));
+	}
+	char *copy = strdup(src); // parse() writes into its input
+	Reg r = parse(&s->names, copy);
+	free(copy);
+	struct group *gr = &s->groups[g];
+	gr->names[gr->n] = strdup(name);
+	gr->sources[gr->n] = strdup(src);
+	gr->rules[gr->n++] = Seq(r, Mark(rule_mark(s, name)));
+	gr->dirty = true;
+}
+void rules_build(Rules *s) {
+	bool changed = false;
+	TRACE_BEGIN("rebuild");
+	for(int g = 0; g < s->ngroups; g++) {
+		struct group *gr = &s->groups[g];
+		if(!gr->dirty)
+			continue;
+		Reg root = Seq(All(), join(OR, gr->rules, gr->n));
+		if(gr->t != NULL)
+			table_free(gr->t);
+		gr->t = NULL;
+		if(label(s->c, root)) {
+			gr->start = s->c->ids[root] - 1;
+		} else {
+			gr->t = table_lazy(&s->names);
+			gr->start = table_row(gr->t, root);
+			gr->t->roots = gr->t->states;
+		}
+		gr->dirty = false;
+		changed = true;
+	}
+	if(changed || s->t == NULL)
+		s->t = table_extend(s->c, s->t);
+	TRACE_END("rebuild");
+}
+// the table keeps every row it ever had, so the states of rules that were removed or
+// replaced would be kept forever. instead the context and the table start over with
+// just the rules there are now, and every node but theirs is collected, see collect()
+// the same goes for the names of their marks, so every rule is parsed again to number
+// its marks afresh, which only ever gives them lower ids than they had
+void rules_collect(Rules *s) {
+	names_free(&s->names);
+	s->nruled = 0;
+	for(int g = 0; g < s->ngroups; g++)
+		for(int i = 0; i < s->groups[g].n; i++) {
+			struct group *gr = &s->groups[g];
+			char *copy = strdup(gr->sources[i]);
+			gr->rules[i] = Seq(parse(&s->names, copy), Mark(rule_mark(s, gr->names[i])));
+			free(copy);
+		}
+	context_reset(s->c);
+	if(s->t != NULL)
+		table_free(s->t);
+	s->t = NULL;
+	for(int g = 0; g < s->ngroups; g++)
+		s->groups[g].dirty = true;
+	rules_build(s);
+	long n = s->c->nstates;
+	for(int g = 0; g < s->ngroups; g++)
+		n += s->groups[g].n + (s->groups[g].t ? s->groups[g].t->states : 0);
+	Reg *roots = malloc(sizeof(Reg) * (n + 1));
+	if(roots == NULL)
+		die("out of memory for collecting");
+	memcpy(roots, s->c->states, sizeof(Reg) * s->c->nstates);
+	n = s->c->nstates;
+	for(int g = 0; g < s->ngroups; g++) {
+		struct group *gr = &s->groups[g];
+		memcpy(&roots[n], gr->rules, sizeof(Reg) * gr->n);
+		n += gr->n;
+		if(gr->t != NULL) {
+			memcpy(&roots[n], gr->t->rows, sizeof(Reg) * gr->t->states);
+			n += gr->t->states;
+		}
+	}
+	collect(roots, n);
+	free(roots);
+}
+// rules_match() passes on only the rules' own marks, not the ones in their patterns
+struct ruling {
+	Rules *s;
+	rdx_callback callback;
+	void *ctx;
+};
+void rule_event(void *ctx, int mark, size_t offset) {
+	struct ruling *ru = ctx;
+	if(mark != RDX_MATCH && mark < ru->s->nruled && ru->s->ruled[mark])
+		ru->callback(ru->ctx, mark, offset);
+}
+// every rule matching somewhere in buf is given to the callback by its mark, at each
+// place it matches, the set is built first if it has changed
+// returns where the last match ended, -1 if nothing matched
+long rules_match(Rules *s, char *buf, size_t len, rdx_callback callback, void *ctx) {
+	rules_build(s);
+	if(collect_due()) // a long-lived set would otherwise keep every derivative it ever made
+		rules_collect(s);
+	struct ruling ru = { s, callback, ctx };
+	long last = -1;
+	for(int g = 0; g < s->ngroups; g++) {
+		if(s->groups[g].n == 0)
+			continue;
+		struct stream st;
+		stream_init(&st, s->groups[g].t ? s->groups[g].t : s->t, s->groups[g].start, &ru);
+		stream_feed(&st, buf, len, rule_event);
+		long end = stream_finish(&st, rule_event);
+		last = end > last ? end : last;
+	}
+	return last;
+}
+#endif
+// dump every counter as a single JSON object
+void dump_stats() {
+	static char *types[] = { "unused", "empty", "all", "none", "lit", "mark", "inf", "not", "seq", "or", "and" };
+	fprintf(stderr, "{\"lookups\":%li,\"created\":%li,\"created_by_type\":{", stats.lookups, stats.created);
+	for(int i = EMPTY; i <= AND; i++)
+		fprintf(stderr, "%s\"%s\":%li", i > EMPTY ? "," : "", types[i], stats.types[i]);
+	fprintf(stderr, "},\"probes\":%li,\"max_probe\":%li,\"mean_probe\":%.2f,", stats.probes, stats.max_probe,
+		stats.lookups ? (double)stats.probes / stats.lookups : 0.0);
+	fprintf(stderr, "\"derive_hits\":%li,\"derive_misses\":%li,\"merges\":%li,\"widest\":%li,",
+		stats.hits, stats.misses, stats.merges, stats.widest);
+	fprintf(stderr, "\"labelled\":%li,\"bytes\":%li,\"collected\":%li,", stats.labelled, stats.bytes, stats.collected);
+	// whether some pattern ran out of budget and fell back to a lazy table, and why
+	fprintf(stderr, "\"fallbacks\":%li,\"fallback\":", stats.fallbacks);
+	fprintf(stderr, fallback ? "\"%s\"}\n" : "null}\n", fallback);
+}
+#ifndef REGDX_NO_MAIN
+void print_event(void *ctx, int mark, size_t offset) {
+	if(mark == RDX_MATCH)
+		printf("%zu match\n", offset);
+	else
+		printf("%zu %s\n", offset, names.name[mark]);
+}
+// each rule is printed once per line
+struct shown {
+	Names *names;
+	bool *seen;
+};
+void print_rule(void *ctx, int mark, size_t offset) {
+	struct shown *sh = ctx;
+	if(mark != RDX_MATCH && !sh->seen[mark]) {
+		sh->seen[mark] = true;
+		printf(" %s", sh->names->name[mark]);
+	}
+}
+// a witness string, with anything unprintable escaped
+void print_witness(char *s, int len) {
+	printf("\"");
+	for(int i = 0; i < len; i++)
+		if(s[i] >= ' ' && s[i] < 127 && s[i] != '"' && s[i] != '\\')
+			printf("%c", s[i]);
+		else
+			printf("\\x%02x", (unsigned char)s[i]);
+	printf("\"");
+}
+void print_match(char *s, size_t start, size_t end) {
+	printf("%zu-%zu %.*s\n", start, end, (int)(end - start), s + start);
+}
+// glushkov for r if --engine or the cost model say so, NULL to build a DFA. the input
+// is stdin, and when it's a pipe there's no telling how much of it there is
+#define UNKNOWN_BYTES (64 << 20)
+Glushkov *pick(Reg r, char *engine) {
+	Glushkov *g = strcmp(engine, "dfa") == 0 ? NULL : glushkov(r);
+	struct stat st;
+	size_t bytes = fstat(0, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : UNKNOWN_BYTES;
+	if(g != NULL && strcmp(engine, "auto") == 0 && !prefer_glushkov(g, r, bytes)) {
+		free(g->follow);
+		free(g);
+		g = NULL;
+	}
+	return g;
+}
 int main(int argc, char *argv[]) {
-	/*Reg *ab = Or(Lit('a', 1), Lit('b', 1));
-	Reg *ba = Or(Lit('b', 1), Lit('a', 1));
+	/*Reg ab = Or(Lit('a', 1), Lit('b', 1));
+	Reg ba = Or(Lit('b', 1), Lit('a', 1));
 	//pr(ab);
 	//pr(ba);
 	pr(merge(OR, ab, ba));
 	//pr(merge(OR, Lit('a', 1), Lit('b', 1)));
 	return 0;*/
+	// --stats can go anywhere, it dumps the counters to stderr on the way out
+	for(int i = 1; i < argc; i++)
+		if(strcmp(argv[i], "--stats") == 0) {
+#ifdef NO_STATS
+			die("built with NO_STATS");
+#endif
+			atexit(dump_stats);
+			memmove(&argv[i], &argv[i + 1], sizeof(char *) * (argc - i));
+			argc--;
+			break;
+		}
+	// --trace <file> writes a timeline of the compile phases on the way out
+	for(int i = 1; i + 1 < argc; i++)
+		if(strcmp(argv[i], "--trace") == 0) {
+			trace_start(argv[i + 1]);
+			atexit(trace_dump);
+			memmove(&argv[i], &argv[i + 2], sizeof(char *) * (argc - i - 1));
+			argc -= 2;
+			break;
+		}
+	// -j <n> builds the DFA with n threads
+	for(int i = 1; i + 1 < argc; i++)
+		if(strcmp(argv[i], "-j") == 0) {
+			jobs = atoi(argv[i + 1]);
+			if(jobs < 1)
+				die("-j needs at least 1 thread");
+			memmove(&argv[i], &argv[i + 2], sizeof(char *) * (argc - i - 1));
+			argc -= 2;
+			break;
+		}
+	// --hops <n> only prints the states dfa can reach in n steps
+	int hops = -1;
+	for(int i = 1; i + 1 < argc; i++)
+		if(strcmp(argv[i], "--hops") == 0) {
+			hops = atoi(argv[i + 1]);
+			memmove(&argv[i], &argv[i + 2], sizeof(char *) * (argc - i - 1));
+			argc -= 2;
+			break;
+		}
+	// --max-states <n>, --max-nodes <n> and --max-time <seconds> budget each DFA, a pattern
+	// past one is scanned by deriving as it goes instead, and dfa gives up
+	for(int i = 1; i + 1 < argc; i++)
+		if(strcmp(argv[i], "--max-states") == 0 || strcmp(argv[i], "--max-nodes") == 0 || strcmp(argv[i], "--max-time") == 0) {
+			if(argv[i][6] == 's')
+				budget.states = atol(argv[i + 1]);
+			else if(argv[i][6] == 'n')
+				budget.nodes = atol(argv[i + 1]);
+			else
+				budget.seconds = atof(argv[i + 1]);
+			memmove(&argv[i], &argv[i + 2], sizeof(char *) * (argc - i - 1));
+			argc -= 2;
+			i--;
+		}
+	// --engine dfa|glushkov|auto is how scan and search without -o match, auto leaves it to
+	// prefer_glushkov(), and patterns glushkov can't do always get a DFA
+	char *engine = "auto";
+	for(int i = 1; i + 1 < argc; i++)
+		if(strcmp(argv[i], "--engine") == 0) {
+			engine = argv[i + 1];
+			if(strcmp(engine, "dfa") != 0 && strcmp(engine, "glushkov") != 0 && strcmp(engine, "auto") != 0)
+				die("--engine is dfa, glushkov or auto");
+			memmove(&argv[i], &argv[i + 2], sizeof(char *) * (argc - i - 1));
+			argc -= 2;
+			break;
+		}
+	// --profile <file> lays out tables by a profile written by the profile command, it's
+	// loaded once the regex is known
+	char *profile_path = NULL;
+	for(int i = 1; i + 1 < argc; i++)
+		if(strcmp(argv[i], "--profile") == 0) {
+			profile_path = argv[i + 1];
+			memmove(&argv[i], &argv[i + 2], sizeof(char *) * (argc - i - 1));
+			argc -= 2;
+			break;
+		}
+	// -o prints every match instead of every matching line, -e makes it the earliest ending ones
+	bool only = false, earliest = false;
+	for(int i = 1; i < argc; i++)
+		if(strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-e") == 0) {
+			*(argv[i][1] == 'o' ? &only : &earliest) = true;
+			memmove(&argv[i], &argv[i + 1], sizeof(char *) * (argc - i));
+			argc--;
+			i--;
+		}
 	if(argc < 2) die("need at least 1 arg");
+	if(profile_path != NULL)
+		profile_load(profile_path, argc > 2 ? argv[2] : "");
+	Context *c = context_new(&names); // every command compiles its patterns into this one
 	if(strcmp(argv[1], "dfa") == 0) {
-		Reg *r = parse(argv[2]);
-		label(r);
-		printf("digraph dfa {\n");
-		dfa(r);
-		printf("}\n");
+		Reg r = parse(&names, argv[2]);
+		if(!label(c, r))
+			die(strcmp(c->over, "space") == 0 ? "dfa ran out of %s" : "dfa ran out of %s, raise --max-%s", c->over, c->over);
+		echo_s("digraph dfa {\n");
+		dfa(c, r, hops);
+		echo_s("}\n");
+		echo_flush();
 		return 0;
 	}
 	if(strcmp(argv[1], "derive") == 0) {
-		Reg *r = parse(argv[3]);
+		Reg r = parse(&names, argv[3]);
 		char *s = argv[2];
 		while(*s != '\0') {
 			print(r);
-			printf("\n");
-			r = derive(*s++, r);
+			echo_c('\n');
+			r = derive((unsigned char)*s++, r);
 		}
 		print(r);
-		printf("\n");
+		echo_c('\n');
+		echo_flush();
+		return 0;
+	}
+	if(strcmp(argv[1], "scan") == 0) {
+		// print every line of stdin that the regex matches in full
+		Reg r = parse(&names, argv[2]);
+		Glushkov *g = pick(r, engine);
+		Table *t = g == NULL ? export(c, r) : NULL;
+		char *line = NULL;
+		size_t cap = 0;
+		ssize_t len;
+		while((len = getline(&line, &cap, stdin)) > 0) {
+			if(line[len - 1] == '\n')
+				len--;
+			if(g != NULL ? glushkov_match(g, line, len) : table_match(t, t->start, line, len))
+				printf("%.*s\n", (int)len, line);
+			if(t != NULL)
+				table_collect(t);
+		}
+		return 0;
+	}
+	if(strcmp(argv[1], "search") == 0) {
+		// print every line of stdin with a match anywhere in it, or with -o every match
+		// -e reports the match that ends first instead of the leftmost-longest one
+		Reg r = parse(&names, argv[2]);
+		Glushkov *g = only ? NULL : pick(r, engine);
+		Finder *f = g == NULL ? finder(c, r) : NULL;
+		char *line = NULL;
+		size_t cap = 0;
+		ssize_t len;
+		while((len = getline(&line, &cap, stdin)) > 0) {
+			if(line[len - 1] == '\n')
+				len--;
+			if(only)
+				find_all(f, line, len, earliest, print_match);
+			else if(g != NULL ? glushkov_search(g, line, len) : search(f, line, len))
+				printf("%.*s\n", (int)len, line);
+			if(f != NULL)
+				table_collect(f->t);
+		}
+		return 0;
+	}
+	if(strcmp(argv[1], "profile") == 0) {
+		// search every line of stdin like search does, counting where the table goes, and
+		// write the counts to a profile for --profile to use with the same regex
+		if(argc < 4)
+			die("profile needs a regex and a file to write");
+		uint32_t regex = pattern_hash(argv[2]);
+		Finder *f = finder(c, parse(&names, argv[2]));
+		if(f->t->lazy) // its rows come and go, see table_flush()
+			die(strcmp(fallback, "space") == 0 ? "profile ran out of %s" : "profile ran out of %s, raise --max-%s", fallback, fallback);
+		long *visits = calloc(f->t->states, sizeof(long)), *uses = calloc((size_t)f->t->states << f->t->shift, sizeof(long));
+		if(visits == NULL || uses == NULL)
+			die("out of memory for profile");
+		char *line = NULL;
+		size_t cap = 0;
+		ssize_t len;
+		while((len = getline(&line, &cap, stdin)) > 0) {
+			if(line[len - 1] == '\n')
+				len--;
+			search_profiled(f, line, len, visits, uses);
+		}
+		profile_write(c, f->t, regex, visits, uses, argv[3]);
+		return 0;
+	}
+	if(strcmp(argv[1], "stream") == 0) {
+		// feed stdin through in whatever pieces read() gives, printing every match end and mark
+		Finder *f = finder(c, parse(&names, argv[2]));
+		struct stream s;
+		stream_init(&s, f->t, f->search, NULL);
+		char buf[4096];
+		ssize_t len;
+		while((len = read(0, buf, sizeof(buf))) > 0) {
+			stream_feed(&s, buf, len, print_event);
+			table_collect(f->t);
+		}
+		stream_finish(&s, print_event);
+		return 0;
+	}
+	if(strcmp(argv[1], "rules") == 0) {
+		// edit a rule set from stdin, a line of "+name regex" adds a rule, "-name" removes
+		// one, and "=text" prints the rules that match anywhere in text, rebuilding first
+		Rules *s = rules_new();
+		char *line = NULL;
+		size_t cap = 0;
+		ssize_t len;
+		while((len = getline(&line, &cap, stdin)) > 0) {
+			if(line[len - 1] == '\n')
+				line[--len] = '\0';
+			if(line[0] == '+') {
+				char *space = strchr(line, ' ');
+				if(space == NULL)
+					die("rule needs a regex: %s", line);
+				*space = '\0';
+				rules_add(s, line + 1, space + 1);
+			} else if(line[0] == '-') {
+				if(!rules_remove(s, line + 1))
+					die("no rule named %s", line + 1);
+			} else if(line[0] == '=') {
+				rules_build(s); // so every mark it can report is named already, collecting only renumbers them lower
+				struct shown sh = { &s->names, calloc(s->names.n + 1, sizeof(bool)) };
+				printf("%s:", line + 1);
+				rules_match(s, line + 1, len - 1, print_rule, &sh);
+				printf("\n");
+				free(sh.seen);
+			}
+		}
+		return 0;
+	}
+	if(strcmp(argv[1], "equiv") == 0 || strcmp(argv[1], "subset") == 0) {
+		// equiv <a> <b> checks if a and b match the same strings, subset <a> <b> checks
+		// if b matches every string a does, the exit status is 0 if so
+		if(argc < 4)
+			die("%s needs 2 regexes", argv[1]);
+		bool sub = strcmp(argv[1], "subset") == 0;
+		Reg a = parse(&names, argv[2]), b = parse(&names, argv[3]);
+		char *witness;
+		long pairs;
+		int len = sub ? subset(a, b, &witness, &pairs) : equiv(a, b, &witness, &pairs);
+		if(len < 0) {
+			printf("%s, after %li pairs\n", sub ? "subset" : "equivalent", pairs);
+			return 0;
+		}
+		Reg d = a;
+		for(int i = 0; i < len; i++)
+			d = derive((unsigned char)witness[i], d);
+		printf("%s, after %li pairs: ", sub ? "not a subset" : "not equivalent", pairs);
+		print_witness(witness, len);
+		printf(" is only matched by the %s\n", tags[d].null ? "first" : "second");
+		return 1;
+	}
+	if(strcmp(argv[1], "find") == 0) {
+		// print where the leftmost-longest match is in every line of stdin that has one
+		Finder *f = finder(c, parse(&names, argv[2]));
+		char *line = NULL;
+		size_t cap = 0, start, end;
+		ssize_t len;
+		while((len = getline(&line, &cap, stdin)) > 0) {
+			if(line[len - 1] == '\n')
+				len--;
+			if(find(f, line, len, 0, &start, &end))
+				printf("%zu-%zu %.*s\n", start, end, (int)(end - start), line + start);
+		}
 		return 0;
 	}
 	die("bad args");
 }
+#endif
 /*
 Inf(Or(Lit(97, 1), Or(Seq(Lit(97, 1), Lit(97, 1)), Seq(Lit(97, 1), Seq(Lit(97, 1), Seq(Lit(97, 1), Lit(97, 1)))))))
 Seq(Or(Lit(97, 1), Or(Seq(Lit(97, 1), Seq(Lit(97, 1), Lit(97, 1))), Empty())), Inf(Or(Lit(97, 1), Or(Seq(Lit(97, 1), Lit(97, 1)), Seq(Lit(97, 1), Seq(Lit(97, 1), Seq(Lit(97, 1), Lit(97, 1))))))))